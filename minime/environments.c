@@ -1,4 +1,10 @@
-/* environments.c -- deals with environments and their contents */
+/* environments.c -- deals with environments and their contents
+
+   An environment is a list of frames, each a list of variables and a
+   list of their values. Top level frames start with a marker, so the
+   local part of an environment, what closures copy from, can be told
+   apart. A value may be a cell, shared with the closures that copied
+   the variable; it is looked through both ways. */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,15 +18,45 @@
 #define enclosing_environment(env) cdr(env)
 #define first_frame(env) car(env)
 
+static object toplevel_marker;
+
 static object make_frame(object vars, object vals)
 {
 	return cons(vars, vals);
 }
 
+static int is_toplevel_frame(object frame)
+{
+	object vars = frame_variables(frame);
+
+	return is_pair(vars) && car(vars) == toplevel_marker;
+}
+
+/* Behind the marker, in a top level frame. That outlives any region,
+   so the binding is made in the heap, and only a value from a region
+   is refused, before anything is linked in. */
 static void add_binding_to_frame(object var, object val, object frame)
 {
-	set_car(frame, cons(var, car(frame)));
-	set_cdr(frame, cons(val, cdr(frame)));
+	object vars = frame_variables(frame), vals = frame_values(frame);
+	object var_pair, val_pair;
+	unsigned long depth;
+
+	if (is_toplevel_frame(frame)) {
+		depth = gc_region_suspend();
+		var_pair = cons(nil, cdr(vars));
+		val_pair = cons(nil, cdr(vals));
+		gc_region_resume(depth);
+
+		set_car(var_pair, var);
+		set_car(val_pair, val);
+
+		set_cdr(vars, var_pair);
+		set_cdr(vals, val_pair);
+		return;
+	}
+
+	set_car(frame, cons(var, vars));
+	set_cdr(frame, cons(val, vals));
 }
 
 object extend_environment(object vars, object vals, object base_env)
@@ -32,7 +68,82 @@ object extend_environment(object vars, object vals, object base_env)
 	return nil; /* not reached */
 }
 
-object lookup_variable_value(object var, object env)
+object make_toplevel_environment(object base_env)
+{
+	if (toplevel_marker == NULL)
+		toplevel_marker = make_string_c("top level");
+
+	return extend_environment(list(1, toplevel_marker), list(1, unspecified), base_env);
+}
+
+int is_toplevel_environment(object env)
+{
+	return is_null(env) || is_toplevel_frame(first_frame(env));
+}
+
+object toplevel_environment(object env)
+{
+	while (!is_toplevel_environment(env))
+		env = enclosing_environment(env);
+
+	return env;
+}
+
+/* the value, or cell, var has in the local part of env */
+int lookup_local_binding(object var, object env, object *binding)
+{
+	object vars, vals;
+
+	for (; !is_toplevel_environment(env); env = enclosing_environment(env))
+		for (vars = frame_variables(first_frame(env)), vals = frame_values(first_frame(env));
+		     !is_null(vars);
+		     vars = cdr(vars), vals = cdr(vals))
+			if (var == car(vars)) {
+				*binding = car(vals);
+				return 1;
+			}
+
+	return 0;
+}
+
+/* the names bound in the local part of env, shadowed ones included */
+object local_variables(object env)
+{
+	object names = nil, vars;
+
+	for (; !is_toplevel_environment(env); env = enclosing_environment(env))
+		for (vars = frame_variables(first_frame(env)); !is_null(vars); vars = cdr(vars))
+			names = cons(car(vars), names);
+
+	return names;
+}
+
+/* Frames are made from the parameter lists of lambdas and the variable
+   lists closures keep, which are where they are in the source, so the
+   variables of the first frame stand for the shape of the whole
+   environment. */
+object environment_shape(object env)
+{
+	return is_null(env) ? nil : frame_variables(first_frame(env));
+}
+
+/* put the values of names in the first frame in cells */
+void box_variables(object names, object env)
+{
+	object frame = first_frame(env);
+	object vars, vals, o;
+
+	for (vars = frame_variables(frame), vals = frame_values(frame);
+	     !is_null(vars);
+	     vars = cdr(vars), vals = cdr(vals))
+		for (o = names; !is_null(o); o = cdr(o))
+			if (car(o) == car(vars)) {
+				set_car(vals, make_cell(car(vals)));
+				break;
+			}
+}
+
+int lookup_variable(object var, object env, object *value)
 {
 	object frame, vars, vals;
 
@@ -43,15 +154,28 @@ object lookup_variable_value(object var, object env)
 		     !is_null(vars);
 		     vars = cdr(vars), vals = cdr(vals)) {
 
-			if (var == car(vars))
-				return car(vals);
+			if (var == car(vars)) {
+				*value = car(vals);
+				if (is_cell(*value))
+					*value = cell_value(*value);
+				return 1;
+			}
 		}
 
 		env = enclosing_environment(env);
 	}
 
-	error("Unbound variable", var);
-	return nil; 			     /* not reached */
+	return 0;
+}
+
+object lookup_variable_value(object var, object env)
+{
+	object val;
+
+	if (!lookup_variable(var, env, &val))
+		error("Unbound variable", var);
+
+	return val;
 }
 
 void set_variable_value(object var, object val, object env)
@@ -66,7 +190,10 @@ void set_variable_value(object var, object val, object env)
 		     vars = cdr(vars), vals = cdr(vals)) {
 
 			if (var == car(vars)) {
-				set_car(vals, val);
+				if (is_cell(car(vals)))
+					set_cell_value(car(vals), val);
+				else
+					set_car(vals, val);
 				return;
 			}
 		}
@@ -87,7 +214,10 @@ void define_variable(object var, object val, object env)
 	     vars = cdr(vars), vals = cdr(vals)) {
 
 		if (var == car(vars)) {
-			set_car(vals, val);
+			if (is_cell(car(vals)))
+				set_cell_value(car(vals), val);
+			else
+				set_car(vals, val);
 			return;
 		}
 	}
@@ -4,8 +4,18 @@
 
 extern void   define_variable(object var, object val, object env);
 extern object lookup_variable_value(object var, object env);
+extern int    lookup_variable(object var, object env, object *value);
 extern void   set_variable_value(object var, object val, object env);
 
 extern object extend_environment(object vars, object vals, object base_env);
 
+/* closures copy from the local part, in front of the top level */
+extern object make_toplevel_environment(object base_env);
+extern int    is_toplevel_environment(object env);
+extern object toplevel_environment(object env);
+extern int    lookup_local_binding(object var, object env, object *binding);
+extern object local_variables(object env);
+extern object environment_shape(object env);
+extern void   box_variables(object names, object env);
+
 #endif
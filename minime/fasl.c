@@ -0,0 +1,591 @@
+/* fasl.c -- a binary encoding of data, quicker to read back than text
+
+   A record is a magic number and a version byte, followed by the
+   object, prefix first: a tag byte, then whatever the tag calls for.
+   Numbers and lengths are base 128 varints, fixnums zigzagged first,
+   so small ones take a byte. Symbols are spelled out the first time,
+   and referred to by number afterwards. Pairs and vectors reachable
+   more than once are labelled, so sharing and cycles survive.
+
+   A list is written as a run of cars and its last cdr, broken where a
+   pair in the middle is shared. The reader allocates a list or vector
+   before reading what goes in it, so labels never need patching, and
+   links everything into the result as soon as it is made, so nothing
+   needs protecting from the collector. Neither side recurses.
+
+   What either side keeps while at it is in the heap, or freed before
+   an error is raised, since the error never comes back. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "minime.h"
+
+#define FASL_MAGIC      "\177FSL"
+#define FASL_MAGIC_SIZE 4
+
+#define FASL_NIL        0
+#define FASL_FALSE      1
+#define FASL_TRUE       2
+#define FASL_FIXNUM     3		     /* zigzag varint */
+#define FASL_CHARACTER  4		     /* a byte */
+#define FASL_STRING     5		     /* length, bytes */
+#define FASL_SYMBOL     6		     /* length, name: gets the next number */
+#define FASL_SYMBOL_REF 7		     /* symbol number */
+#define FASL_LIST       8		     /* count, cars, last cdr */
+#define FASL_VECTOR     9		     /* length, elements */
+#define FASL_LABEL      10		     /* label, then the object */
+#define FASL_REF        11		     /* label */
+#define FASL_BYTEVECTOR 12		     /* length, bytes */
+
+#define FASL_STACK_MIN  64
+#define FASL_TABLE_MIN  64
+
+/* a list being walked or filled in, or a vector */
+struct fasl_frame {
+	object o;			     /* the pair at hand, or the vector */
+	unsigned long next;		     /* what is done of it */
+	unsigned long count;		     /* cars, or elements */
+};
+
+/* Past the small stack, frames go in a bytevector, kept alive by the
+   pointer into it. What they refer to is part of the object being
+   read or written, and reachable from it anyway. */
+static struct fasl_frame *push_frame(struct fasl_frame **stack, struct fasl_frame *small,
+				     unsigned long *depth, unsigned long *size)
+{
+	struct fasl_frame *bigger;
+
+	if (*depth == *size) {
+		bigger = (struct fasl_frame *)
+			bytevector_value(make_bytevector(2 * *size * sizeof(struct fasl_frame)));
+		memcpy(bigger, *stack, *size * sizeof(struct fasl_frame));
+
+		*stack = bigger;
+		*size *= 2;
+	}
+
+	return &(*stack)[(*depth)++];
+}
+
+
+/* Writing */
+
+/* the symbols written so far and their numbers, keyed on address */
+struct symbol_table {
+	unsigned long size, count;	     /* size always a power of two */
+	object *keys;
+	unsigned long *numbers;
+};
+
+static void symbol_table_alloc(struct symbol_table *table, unsigned long size)
+{
+	table->size    = size;
+	table->count   = 0;
+	table->keys    = xcalloc(size, sizeof(object));
+	table->numbers = xcalloc(size, sizeof(unsigned long));
+}
+
+static unsigned long symbol_slot(struct symbol_table *table, object symbol)
+{
+	unsigned long mask = table->size - 1;
+	unsigned long i = symbol_hash(symbol) & mask;
+
+	while (table->keys[i] != NULL && table->keys[i] != symbol)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+/* the number of a symbol written before, or -1 after giving it one */
+static long symbol_number(struct symbol_table *table, object symbol)
+{
+	object *keys = table->keys;
+	unsigned long *numbers = table->numbers;
+	unsigned long i, j, old_size = table->size;
+
+	i = symbol_slot(table, symbol);
+	if (table->keys[i] != NULL)
+		return table->numbers[i];
+
+	/* keep the load under one half */
+	if (2 * (table->count + 1) > table->size) {
+		symbol_table_alloc(table, 2 * old_size);
+
+		for (j = 0; j < old_size; j++)
+			if (keys[j] != NULL) {
+				table->count++;
+				i = symbol_slot(table, keys[j]);
+				table->keys[i] = keys[j];
+				table->numbers[i] = numbers[j];
+			}
+
+		xfree(keys);
+		xfree(numbers);
+
+		i = symbol_slot(table, symbol);
+	}
+
+	table->keys[i] = symbol;
+	table->numbers[i] = table->count++;
+
+	return -1;
+}
+
+static void put_number(struct port *out, unsigned long n)
+{
+	while (n >= 0x80) {
+		port_putc(out, (n & 0x7f) | 0x80);
+		n >>= 7;
+	}
+
+	port_putc(out, n);
+}
+
+static void put_bytes(struct port *out, char *s, unsigned long n)
+{
+	put_number(out, n);
+	port_write(out, s, n);
+}
+
+/* 0 if exp can't be written */
+static int write_atom(object exp, struct port *out, struct symbol_table *symbols)
+{
+	object name;
+	long n;
+
+	switch (type_of(exp)) {
+	case T_NIL:
+		port_putc(out, FASL_NIL);
+		break;
+
+	case T_BOOLEAN:
+		port_putc(out, is_false(exp) ? FASL_FALSE : FASL_TRUE);
+		break;
+
+	case T_FIXNUM:
+		n = fixnum_value(exp);
+		port_putc(out, FASL_FIXNUM);
+		put_number(out, ((unsigned long) n << 1) ^ (unsigned long) (n >> 63));
+		break;
+
+	case T_CHARACTER:
+		port_putc(out, FASL_CHARACTER);
+		port_putc(out, character_value(exp));
+		break;
+
+	case T_STRING:
+		port_putc(out, FASL_STRING);
+		put_bytes(out, string_value(exp), string_length(exp));
+		break;
+
+	case T_BYTEVECTOR:
+		port_putc(out, FASL_BYTEVECTOR);
+		put_bytes(out, (char *) bytevector_value(exp), bytevector_length(exp));
+		break;
+
+	case T_SYMBOL:
+		if ((n = symbol_number(symbols, exp)) >= 0) {
+			port_putc(out, FASL_SYMBOL_REF);
+			put_number(out, n);
+		} else {
+			name = symbol_string(exp);
+			port_putc(out, FASL_SYMBOL);
+			put_bytes(out, string_value(name), string_length(name));
+		}
+		break;
+
+	case T_VECTOR:			     /* only the empty one gets here */
+		port_putc(out, FASL_VECTOR);
+		put_number(out, 0);
+		break;
+
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+void fasl_write(object exp, struct port *out)
+{
+	struct fasl_frame small[FASL_STACK_MIN], *stack = small, *top;
+	unsigned long depth = 0, size = FASL_STACK_MIN, count;
+	struct shared_table shared;
+	struct symbol_table symbols;
+	object rest, bad = NULL;
+	long label;
+	int fresh;
+
+	shared_table_init(&shared);
+	shared_scan(&shared, exp);
+	symbol_table_alloc(&symbols, FASL_TABLE_MIN);
+
+	port_write(out, FASL_MAGIC, FASL_MAGIC_SIZE);
+	port_putc(out, FASL_VERSION);
+
+	while (1) {
+		if ((label = shared_label(&shared, exp, &fresh)) >= 0) {
+			port_putc(out, fresh ? FASL_LABEL : FASL_REF);
+			put_number(out, label);
+		}
+
+		if (label >= 0 && !fresh)
+			;			     /* just the reference */
+		else if (is_pair(exp)) {
+			for (count = 1, rest = cdr(exp);
+			     is_pair(rest) && !shared_is_shared(&shared, rest);
+			     rest = cdr(rest))
+				count++;
+
+			port_putc(out, FASL_LIST);
+			put_number(out, count);
+
+			top = push_frame(&stack, small, &depth, &size);
+			top->o = exp;
+			top->next = 1;
+			top->count = count;
+			exp = car(exp);
+			continue;
+		}
+		else if (is_vector(exp) && vector_length(exp) > 0) {
+			port_putc(out, FASL_VECTOR);
+			put_number(out, vector_length(exp));
+
+			top = push_frame(&stack, small, &depth, &size);
+			top->o = exp;
+			top->next = 1;
+			top->count = vector_length(exp);
+			exp = vector_ref(exp, 0);
+			continue;
+		}
+		else if (!write_atom(exp, out, &symbols)) {
+			bad = exp;
+			break;
+		}
+
+		/* then whatever follows it */
+		while (depth > 0) {
+			top = &stack[depth - 1];
+
+			if (is_vector(top->o)) {
+				if (top->next < top->count) {
+					exp = vector_ref(top->o, top->next++);
+					break;
+				}
+			}
+			else if (top->next < top->count) {
+				top->o = cdr(top->o);
+				top->next++;
+				exp = car(top->o);
+				break;
+			}
+			else if (top->next == top->count) {
+				top->next++;
+				exp = cdr(top->o);
+				break;
+			}
+
+			depth--;
+		}
+
+		if (depth == 0)
+			break;
+	}
+
+	xfree(symbols.keys);
+	xfree(symbols.numbers);
+	shared_table_free(&shared);
+
+	if (bad != NULL)
+		error("Object cannot be written -- fasl-write", bad);
+}
+
+
+/* Reading */
+
+/* the tables are vectors, nil until something goes in them */
+struct fasl_in {
+	struct port *port;
+
+	object symbols;			     /* by number */
+	unsigned long nsymbols;
+
+	object labels;
+	unsigned long nlabels;
+};
+
+/* where a bad record goes instead of raising an error, when reading
+   for fasl_try_read */
+static jmp_buf *fasl_failure;
+
+static void fasl_error(char *msg, object o)
+{
+	if (fasl_failure != NULL)
+		longjmp(*fasl_failure, 1);
+
+	error(msg, o);
+}
+
+static int get_byte(struct port *in)
+{
+	int c = port_getc(in);
+
+	if (c == EOF)
+		fasl_error("Unexpected EOF -- fasl-read", nil);
+
+	return c;
+}
+
+static unsigned long get_number(struct port *in)
+{
+	unsigned long n = 0;
+	int c, shift = 0;
+
+	do {
+		if (shift > 63)
+			fasl_error("Ill-formed number -- fasl-read", nil);
+
+		c = get_byte(in);
+		n |= (unsigned long) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	return n;
+}
+
+/* a length, or a count of elements, each a byte at least: a damaged
+   record can't make it allocate more than is left to read */
+static unsigned long get_count(struct port *in)
+{
+	unsigned long n = get_number(in);
+
+	if (n > in->end - in->start && n > port_available(in))
+		fasl_error("Ill-formed count -- fasl-read", nil);
+
+	return n;
+}
+
+/* the next number in a table growing one at a time */
+static void table_add(object *table, unsigned long *count, object o)
+{
+	object bigger;
+	unsigned long i;
+
+	if (*count == (is_null(*table) ? 0 : vector_length(*table))) {
+		bigger = make_vector(MAX(2 * *count, FASL_TABLE_MIN), nil);
+
+		for (i = 0; i < *count; i++)
+			vector_set(bigger, i, vector_ref(*table, i));
+
+		*table = bigger;
+	}
+
+	vector_set(*table, (*count)++, o);
+}
+
+static object read_string(struct port *in)
+{
+	unsigned long len = get_count(in);
+	object s = make_string(len);
+
+	if (port_read(in, string_value(s), len) != len)
+		fasl_error("Unexpected EOF -- fasl-read", nil);
+
+	return s;
+}
+
+static object read_bytevector(struct port *in)
+{
+	unsigned long len = get_count(in);
+	object bv = make_bytevector(len);
+
+	if (port_read(in, (char *) bytevector_value(bv), len) != len)
+		fasl_error("Unexpected EOF -- fasl-read", nil);
+
+	return bv;
+}
+
+static object read_symbol(struct fasl_in *f)
+{
+	object name = read_string(f->port);
+	object symbol = make_symbol(string_value(name), string_length(name));
+
+	table_add(&f->symbols, &f->nsymbols, symbol);
+
+	return symbol;
+}
+
+/* Gives a value to the innermost list or vector, dropping it once it
+   is full. */
+static void store(struct fasl_frame *top, unsigned long *depth, object value)
+{
+	if (is_vector(top->o)) {
+		vector_set(top->o, top->next++, value);
+
+		if (top->next == top->count)
+			(*depth)--;
+
+		return;
+	}
+
+	if (top->next < top->count) {
+		set_car(top->o, value);
+
+		if (++top->next < top->count)
+			top->o = cdr(top->o);
+
+		return;
+	}
+
+	set_cdr(top->o, value);
+	(*depth)--;
+}
+
+static object read_record(struct port *in)
+{
+	struct fasl_frame small[FASL_STACK_MIN], *stack = small, *top;
+	unsigned long depth = 0, size = FASL_STACK_MIN, count, n;
+	struct fasl_in f = { .port = in, .symbols = nil, .labels = nil };
+	char magic[FASL_MAGIC_SIZE];
+	object result = nil, value, pair;
+	long label;
+	int tag;
+
+	if ((n = port_read(in, magic, FASL_MAGIC_SIZE)) == 0)
+		return end_of_file;
+
+	if (n != FASL_MAGIC_SIZE || memcmp(magic, FASL_MAGIC, FASL_MAGIC_SIZE))
+		fasl_error("Not a fasl record -- fasl-read", nil);
+
+	if (get_byte(in) != FASL_VERSION)
+		fasl_error("Unsupported fasl version -- fasl-read", nil);
+
+	while (1) {
+		count = 0;
+		label = -1;
+
+		if ((tag = get_byte(in)) == FASL_LABEL) {
+			label = get_number(in);
+			tag = get_byte(in);
+
+			if (label != f.nlabels)
+				fasl_error("Ill-formed label -- fasl-read", make_fixnum(label));
+		}
+
+		switch (tag) {
+		case FASL_NIL:
+			value = nil;
+			break;
+
+		case FASL_FALSE:
+			value = the_falsity;
+			break;
+
+		case FASL_TRUE:
+			value = the_truth;
+			break;
+
+		case FASL_FIXNUM:
+			n = get_number(in);
+			value = make_fixnum((long) (n >> 1) ^ -(long) (n & 1));
+			break;
+
+		case FASL_CHARACTER:
+			value = make_character(get_byte(in));
+			break;
+
+		case FASL_STRING:
+			value = read_string(in);
+			break;
+
+		case FASL_BYTEVECTOR:
+			value = read_bytevector(in);
+			break;
+
+		case FASL_SYMBOL:
+			value = read_symbol(&f);
+			break;
+
+		case FASL_SYMBOL_REF:
+			if ((n = get_number(in)) >= f.nsymbols)
+				fasl_error("Unknown symbol -- fasl-read", make_fixnum(n));
+
+			value = vector_ref(f.symbols, n);
+			break;
+
+		case FASL_LIST:
+			if ((count = get_count(in)) == 0)
+				fasl_error("Empty list run -- fasl-read", nil);
+
+			value = cons(nil, nil);
+			break;
+
+		case FASL_VECTOR:
+			count = get_count(in);
+			value = make_vector(count, nil);
+			break;
+
+		case FASL_REF:
+			if ((n = get_number(in)) >= f.nlabels)
+				fasl_error("Unknown label -- fasl-read", make_fixnum(n));
+
+			value = vector_ref(f.labels, n);
+			break;
+
+		default:
+			fasl_error("Unknown tag -- fasl-read", make_fixnum(tag));
+		}
+
+		if (label >= 0)
+			table_add(&f.labels, &f.nlabels, value);
+
+		if (depth == 0)
+			result = value;
+		else
+			store(&stack[depth - 1], &depth, value);
+
+		/* then fill it in */
+		if (count > 0) {
+			top = push_frame(&stack, small, &depth, &size);
+			top->o = value;
+			top->next = 0;
+			top->count = count;
+
+			for (pair = value; is_pair(value) && --count > 0; pair = cdr(pair))
+				set_cdr(pair, cons(nil, nil));
+		}
+
+		if (depth == 0)
+			break;
+	}
+
+	return result;
+}
+
+object fasl_read(struct port *in)
+{
+	fasl_failure = NULL;
+	return read_record(in);
+}
+
+/* Nothing is left to clean up after a bad record, everything is in
+   the heap. */
+object fasl_try_read(struct port *in, object failure)
+{
+	jmp_buf here;
+	object result;
+
+	if (setjmp(here)) {
+		fasl_failure = NULL;
+		return failure;
+	}
+
+	fasl_failure = &here;
+	result = read_record(in);
+	fasl_failure = NULL;
+
+	return result;
+}
@@ -0,0 +1,12 @@
+#ifndef __FASL_H
+#define __FASL_H
+
+#define FASL_VERSION 1
+
+extern void   fasl_write(object exp, struct port *out);
+extern object fasl_read(struct port *in);
+
+/* failure instead of an error, when the record is not a good one */
+extern object fasl_try_read(struct port *in, object failure);
+
+#endif
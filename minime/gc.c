@@ -0,0 +1,1850 @@
+/* gc.c -- non-moving mark and sweep collector
+
+   The heap is a block of pages, each given over to one kind of object
+   (a big bag of pages). Small objects are rounded up to a size class
+   and share pages with others of their class. Pairs have pages of their
+   own, since they have no header to tell them by. Medium sized objects
+   take a run of whole pages. The page table says what any address
+   holds, and a bitmap with a bit for every word an object starts at
+   says which slots are in use, so the heap can be walked.
+
+   Marking starts from anything that looks like a pointer into the heap
+   on the C stack, in the registers and in the data segment, so C code
+   can keep objects in plain variables. Tables living in malloc memory
+   are marked by their owners. Nothing ever moves.
+
+   Sweeping puts the dead slots of each page on the free list of its
+   class, in address order, and pages left empty on a list of free
+   runs. Allocation pops the free list of the class, or bumps through a
+   fresh page.
+
+   With a pause budget, a cycle is spread over the allocations that
+   follow its start: every so many allocations the collector marks or
+   sweeps for at most the budget. While marking, stores into the heap
+   shade the stored object (gc_write_barrier) and new objects are
+   allocated grey, to be scanned once initialized. Roots are scanned
+   again at the end, since the C stack has no barrier. Sweeping is
+   lazy, allocation only takes slots and pages already swept.
+
+   Objects of GC_LARGE_WORDS or more get their own mapping instead,
+   found by address in a sorted table. They are never moved or copied
+   around, and are unmapped when found dead.
+
+   Weak boxes and ephemerons don't mark what they hold weakly, they are
+   remembered instead. Once everything else is marked, ephemerons whose
+   keys turned out live get their values marked, over and over until
+   that marks nothing new. Then the rest are broken, and so are the weak
+   boxes of unmarked values. Memo tables are treated as ephemerons.
+
+   Objects holding on to something outside the heap, a file or foreign
+   memory, can have a finalizer registered. The table of them is not
+   marked from; those left unmarked when the weak references are broken
+   have their release function queued, and the object is swept as any
+   other. The queue is run later at a safe point (gc_run_finalizers),
+   never from inside an allocation.
+
+   Marking done all at once can be shared by several threads. Each has
+   its own stack of grey objects and steals half of someone else's when
+   it runs out. Mark bits are then set atomically.
+
+   Inside a region, allocation bumps through chunks of an arena instead,
+   each chunk owned by one region. Exiting the region hands its chunks
+   back without looking at what is in them, after copying the result
+   out. The chunks in use are scanned as roots, conservatively.
+
+   Built with COMPRESSED_POINTERS, pairs and vectors hold 32 bit
+   references, offsets from gc_window. The heap and the arena are then
+   mapped together there, at most 4 GB of them, and large objects stay
+   in the heap as runs of pages, since mappings of their own might be
+   out of reach. Arena chunks are scanned for references as well as
+   for whole words. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <assert.h>
+
+#include "minime.h"
+
+#define GC_PAGE_WORDS  512
+#define GC_SMALL_WORDS 256		     /* objects up to this size share pages */
+#if COMPRESSED_POINTERS
+#define GC_LARGE_WORDS (~0UL)
+#else
+#define GC_LARGE_WORDS 4096		     /* objects from this size on are mapped */
+#endif
+
+#define GC_SLICE_ALLOCATIONS 256	     /* between incremental steps */
+#define GC_SCAN_WORDS        512	     /* of a vector, scanned at once */
+#define GC_SWEEP_PAGES       8		     /* swept between clock checks */
+#define GC_PAUSE_BUCKETS     24		     /* powers of two, in microseconds */
+
+#define GC_CHUNK_WORDS   8192		     /* of a region arena */
+#define GC_ARENA_CHUNKS  16384		     /* a gigabyte of address space */
+#define GC_ARENA_BYTES   (GC_ARENA_CHUNKS * GC_CHUNK_WORDS * sizeof(unsigned long))
+#define GC_MAX_REGIONS   256
+
+enum { GC_IDLE, GC_MARKING, GC_SWEEPING };
+
+static int phase = GC_IDLE;
+int gc_marking;
+
+/* microseconds per step, 0 collects all at once when the heap is full */
+unsigned long gc_pause_budget;
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+static unsigned long *heap, *heap_end;
+
+static unsigned long *start_bits;	     /* an object starts at this word */
+static unsigned long *mark_bits;
+
+enum { PAGE_FREE, PAGE_PAIRS, PAGE_SMALL, PAGE_RUN, PAGE_RUN_TAIL };
+
+struct page {
+	unsigned char kind;
+	unsigned char class;		     /* of the pairs or small objects */
+	unsigned short pages;		     /* in the run, or back to its start */
+};
+
+static struct page *pages;
+static unsigned long page_count;
+
+/* the first class is for pairs */
+static const unsigned short class_words[] = {
+	PAIR_WORDS,
+	1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16,
+	17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+	40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+
+#define GC_CLASSES (sizeof(class_words) / sizeof(class_words[0]))
+#define PAIR_CLASS 0
+#define RUN_CLASS  GC_CLASSES		     /* not a class, a run of pages */
+
+struct size_class {
+	unsigned long words;
+	unsigned long *free;
+	unsigned long *bump, *bump_end;	     /* through its newest page */
+};
+
+static struct size_class classes[GC_CLASSES];
+static unsigned char class_of[GC_SMALL_WORDS + 1];
+
+/* runs of free pages, with their length in the second word */
+static unsigned long *free_runs;
+
+/* an object to scan, or the rest of a vector from a slot on */
+struct grey {
+	unsigned long *p;
+	object_ref *from;
+};
+
+struct mark_stack {
+	struct grey *items;
+	unsigned long sp, size;
+
+	pthread_mutex_t lock;		     /* when marking in parallel */
+};
+
+#define GC_MAX_THREADS 64
+
+unsigned long gc_threads = 1;
+
+static struct mark_stack mark_stacks[GC_MAX_THREADS];
+static __thread struct mark_stack *mark_stack = &mark_stacks[0];
+
+static int marking_in_parallel;
+static unsigned long idle_markers;
+
+static pthread_mutex_t markers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  markers_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  markers_done  = PTHREAD_COND_INITIALIZER;
+static unsigned long   markers_epoch, markers_finished;
+
+/* weak boxes and ephemerons met while marking */
+struct weak_list {
+	unsigned long **items;
+	unsigned long count, size;
+};
+
+static struct weak_list weak_boxes, ephemerons;
+static pthread_mutex_t weak_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct finalizer {
+	object o;
+	void (*release)(void *);
+	void *data;
+};
+
+struct finalizer_list {
+	struct finalizer *items;
+	unsigned long count, size;
+};
+
+/* registered, and released but not yet run */
+static struct finalizer_list finalizable, finalizers_due;
+unsigned long gc_finalizers_pending;
+
+struct large_object {
+	unsigned long *p;
+	unsigned long words;
+	size_t bytes;			     /* mapped */
+	int marked;
+};
+
+/* sorted by address */
+static struct {
+	struct large_object *objects;
+	unsigned long count, size;
+
+	unsigned long *low, *high;	     /* bounds of all of them */
+
+	unsigned long mapped;		     /* bytes, currently */
+	unsigned long since;		     /* ... mapped since the last collection */
+	unsigned long live;		     /* ... left after it */
+} large;
+
+/* sweeping position, and the free pages just behind it */
+static unsigned long sweep_page;
+static unsigned long free_run_start, free_run_pages;
+
+static struct {
+	unsigned long collections;
+	unsigned long allocated;	     /* words, since startup */
+	unsigned long live;		     /* words, after the last collection */
+	unsigned long free;		     /* ... and free */
+	unsigned long trigger;		     /* allocated words to start a cycle at */
+	unsigned long countdown;	     /* allocations to the next step */
+	unsigned long forced;		     /* cycles finished at once, out of memory */
+	unsigned long finalized;
+
+	unsigned long usecs, max_pause;
+	unsigned long pauses[GC_PAUSE_BUCKETS];
+} gc;
+
+struct chunk {
+	unsigned long depth;		     /* of the region owning it, 0 if free */
+	unsigned long count;		     /* in a run given to one object */
+	long next;			     /* the region's previous chunk */
+};
+
+static unsigned long *arena, *arena_end;
+static struct chunk *chunks;
+static unsigned long arena_top;		     /* chunks ever used */
+static unsigned long chunks_in_use;
+
+struct region {
+	unsigned long *bump, *end;
+	long chunks;			     /* the newest */
+};
+
+unsigned long gc_region_depth;
+
+#if COMPRESSED_POINTERS
+char *gc_window;
+#endif
+static struct region regions[GC_MAX_REGIONS + 1];
+
+/* copies of region objects, by address of the original */
+static struct {
+	object *from, *to;
+	unsigned long size, count;
+} forwards;
+
+static struct {
+	unsigned long entered;
+	unsigned long allocated;	     /* words */
+	unsigned long copied;		     /* ... out */
+	unsigned long most_chunks;
+} region_stats;
+
+/* set up by the C runtime */
+extern char __data_start[], _end[];
+extern void *__libc_stack_end;
+
+
+/* Bitmaps */
+
+static inline unsigned long word_index(unsigned long *p)
+{
+	return p - heap;
+}
+
+static inline int test_bit(unsigned long *bits, unsigned long i)
+{
+	return (bits[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+}
+
+static inline void set_bit(unsigned long *bits, unsigned long i)
+{
+	bits[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+}
+
+static inline void clear_bit(unsigned long *bits, unsigned long i)
+{
+	bits[i / BITS_PER_WORD] &= ~(1UL << (i % BITS_PER_WORD));
+}
+
+
+/* Pages */
+
+static inline unsigned long page_index(unsigned long *p)
+{
+	return (p - heap) / GC_PAGE_WORDS;
+}
+
+static inline unsigned long *page_base(unsigned long n)
+{
+	return heap + n * GC_PAGE_WORDS;
+}
+
+
+/* Objects */
+
+static inline unsigned long *object_address(object o)
+{
+	if (is_pair(o))
+		return (unsigned long *) ((unsigned long) o - PAIR_TAG);
+
+	if (is_indirect(o))
+		return (unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+
+	return NULL;
+}
+
+static unsigned long header_words(unsigned long header)
+{
+	switch (header & 3) {
+	case STRING_TAG:
+		return 1 + ((header >> STRING_SHIFT) + sizeof(unsigned long)) / sizeof(unsigned long);
+
+	case BYTEVECTOR_TAG:
+		return 1 + ((header >> BYTEVECTOR_SHIFT) + sizeof(unsigned long) - 1) / sizeof(unsigned long);
+
+	case VECTOR_TAG:
+		return 1 + ref_words(header >> VECTOR_SHIFT);
+	}
+
+	switch (header & 0xFF) {
+	case PROCEDURE_TAG:
+		return 5;
+
+	case MACRO_TAG:
+		return 4;
+
+	case SYMBOL_TAG:
+	case PORT_TAG:
+	case SYNTAX_RULES_TAG:
+	case EPHEMERON_TAG:
+	case WEAK_TABLE_TAG:
+		return 3;
+
+	case FOREIGN_PTR_TAG:
+	case PRIMITIVE_PROC_TAG:
+	case WEAK_BOX_TAG:
+	case BOXED_FIXNUM_TAG:
+	case CELL_TAG:
+		return 2;
+	}
+
+	/* the empty list, booleans, eof, unspecified */
+	return 1;
+}
+
+static unsigned long object_words(unsigned long *p)
+{
+	if (pages[page_index(p)].kind == PAGE_PAIRS)
+		return 2;
+
+	return header_words(p[0]);
+}
+
+/* the header and the words after it holding objects, vectors hold
+   references instead */
+static unsigned long pointer_words(unsigned long header)
+{
+	switch (header & 3) {
+	case STRING_TAG:
+	case BYTEVECTOR_TAG:
+	case VECTOR_TAG:
+		return 1;
+	}
+
+	switch (header & 0xFF) {
+	case PROCEDURE_TAG:
+		return 5;
+
+	case MACRO_TAG:
+		return 4;
+
+	case SYNTAX_RULES_TAG:
+	case EPHEMERON_TAG:
+	case WEAK_TABLE_TAG:
+		return 3;
+
+	case SYMBOL_TAG:		     /* the hash is not one */
+	case WEAK_BOX_TAG:
+	case CELL_TAG:
+		return 2;
+	}
+
+	return 1;
+}
+
+/* the start of the object p points into, if any */
+static unsigned long *object_start(unsigned long *p)
+{
+	unsigned long n = page_index(p);
+	unsigned long *start, words, slot;
+
+	switch (pages[n].kind) {
+	case PAGE_FREE:
+		return NULL;
+
+	case PAGE_RUN_TAIL:
+		n -= pages[n].pages;
+		/* fall through */
+	case PAGE_RUN:
+		start = page_base(n);
+		break;
+
+	default:
+		/* slots don't always fill the page */
+		words = classes[pages[n].class].words;
+		slot  = (p - page_base(n)) / words;
+		if (slot >= GC_PAGE_WORDS / words)
+			return NULL;
+
+		start = page_base(n) + slot * words;
+		break;
+	}
+
+	if (!test_bit(start_bits, word_index(start)) || p >= start + object_words(start))
+		return NULL;
+
+	return start;
+}
+
+
+static unsigned long usecs()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/* Marking */
+
+static void stack_reserve(struct mark_stack *stack, unsigned long n)
+{
+	if (stack->sp + n <= stack->size)
+		return;
+
+	stack->size  = MAX(2 * stack->size, MAX(stack->sp + n, 1024));
+	stack->items = xrealloc(stack->items, stack->size * sizeof(struct grey));
+}
+
+static void push_grey(unsigned long *p, object_ref *from)
+{
+	struct mark_stack *stack = mark_stack;
+
+	if (marking_in_parallel)
+		pthread_mutex_lock(&stack->lock);
+
+	stack_reserve(stack, 1);
+	stack->items[stack->sp].p    = p;
+	stack->items[stack->sp].from = from;
+	stack->sp++;
+
+	if (marking_in_parallel)
+		pthread_mutex_unlock(&stack->lock);
+}
+
+static int pop_grey(struct grey *grey)
+{
+	struct mark_stack *stack = mark_stack;
+	int found = 0;
+
+	if (marking_in_parallel)
+		pthread_mutex_lock(&stack->lock);
+
+	if (stack->sp > 0) {
+		*grey = stack->items[--stack->sp];
+		found = 1;
+	}
+
+	if (marking_in_parallel)
+		pthread_mutex_unlock(&stack->lock);
+
+	return found;
+}
+
+static void mark_start(unsigned long *p)
+{
+	unsigned long i = word_index(p);
+	unsigned long bit = 1UL << (i % BITS_PER_WORD);
+
+	if (marking_in_parallel) {
+		if (__atomic_fetch_or(&mark_bits[i / BITS_PER_WORD], bit, __ATOMIC_RELAXED) & bit)
+			return;
+	} else {
+		if (mark_bits[i / BITS_PER_WORD] & bit)
+			return;
+
+		mark_bits[i / BITS_PER_WORD] |= bit;
+	}
+
+	push_grey(p, NULL);
+}
+
+/* the large object p points into, if any */
+static struct large_object *large_object_containing(unsigned long *p)
+{
+	unsigned long low = 0, high = large.count, mid;
+	struct large_object *lo;
+
+	if (p < large.low || p >= large.high)
+		return NULL;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		lo  = &large.objects[mid];
+
+		if (p < lo->p)
+			high = mid;
+		else if (p >= lo->p + lo->words)
+			low = mid + 1;
+		else
+			return lo;
+	}
+
+	return NULL;
+}
+
+static void mark_large(struct large_object *lo)
+{
+	if (marking_in_parallel) {
+		if (__atomic_exchange_n(&lo->marked, 1, __ATOMIC_RELAXED))
+			return;
+	} else {
+		if (lo->marked)
+			return;
+
+		lo->marked = 1;
+	}
+
+	push_grey(lo->p, NULL);
+}
+
+static inline int in_arena(unsigned long *p)
+{
+	return p >= arena && p < arena_end;
+}
+
+void gc_mark(object o)
+{
+	struct large_object *lo;
+	unsigned long *p;
+
+	if ((p = object_address(o)) == NULL)
+		return;
+
+	if (p >= heap && p < heap_end) {
+		mark_start(p);
+	} else if ((lo = large_object_containing(p)) != NULL) {
+		mark_large(lo);
+	} else {
+		/* the arena is scanned whole */
+		assert(in_arena(p));
+	}
+}
+
+/* objects outside the heap and the large ones are never collected */
+static int is_marked(object o)
+{
+	struct large_object *lo;
+	unsigned long *p;
+
+	if ((p = object_address(o)) == NULL)
+		return 1;
+
+	if (p >= heap && p < heap_end)
+		return test_bit(mark_bits, word_index(p));
+
+	if ((lo = large_object_containing(p)) != NULL)
+		return lo->marked;
+
+	return 1;
+}
+
+int gc_is_live(object o)
+{
+	return is_marked(o);
+}
+
+static void remember(struct weak_list *list, unsigned long *p)
+{
+	if (marking_in_parallel)
+		pthread_mutex_lock(&weak_lock);
+
+	if (list->count == list->size) {
+		list->size  = MAX(2 * list->size, 256);
+		list->items = xrealloc(list->items, list->size * sizeof(unsigned long *));
+	}
+
+	list->items[list->count++] = p;
+
+	if (marking_in_parallel)
+		pthread_mutex_unlock(&weak_lock);
+}
+
+/* a word that may or may not point into some object */
+static void mark_ambiguous(unsigned long word)
+{
+	unsigned long *p = (unsigned long *) (word & ~(sizeof(unsigned long) - 1));
+	struct large_object *lo;
+
+	if (p >= heap && p < heap_end) {
+		if ((p = object_start(p)) != NULL)
+			mark_start(p);
+	} else if ((lo = large_object_containing(p)) != NULL) {
+		mark_large(lo);
+	}
+}
+
+static void mark_range(void *from, void *to)
+{
+	unsigned long *w = (unsigned long *) (((unsigned long) from + sizeof(unsigned long) - 1) &
+					      ~(sizeof(unsigned long) - 1));
+
+	for (; w + 1 <= (unsigned long *) to; w++)
+		mark_ambiguous(*w);
+}
+
+/* a long vector is scanned a piece at a time, the rest goes back */
+static void scan_vector(unsigned long *p, object_ref *slot)
+{
+	object_ref *end = (object_ref *) (p + 1) + (p[0] >> VECTOR_SHIFT);
+
+	if (end - slot > GC_SCAN_WORDS) {
+		push_grey(p, slot + GC_SCAN_WORDS);
+		end = slot + GC_SCAN_WORDS;
+	}
+
+	for (; slot < end; slot++)
+		gc_mark(referenced_object(*slot));
+}
+
+static void scan_object(unsigned long *p)
+{
+	/* large objects are never pairs */
+	if (p >= heap && p < heap_end && pages[page_index(p)].kind == PAGE_PAIRS) {
+		gc_mark(referenced_object(((object_ref *) p)[0]));
+		gc_mark(referenced_object(((object_ref *) p)[1]));
+		return;
+	}
+
+	switch (p[0] & 3) {
+	case STRING_TAG:
+	case BYTEVECTOR_TAG:
+		return;
+
+	case VECTOR_TAG:
+		scan_vector(p, (object_ref *) (p + 1));
+		return;
+	}
+
+	switch (p[0] & 0xFF) {
+	case PROCEDURE_TAG:
+		gc_mark((object) p[4]);
+		/* fall through */
+	case MACRO_TAG:
+		gc_mark((object) p[3]);
+		/* fall through */
+	case SYNTAX_RULES_TAG:
+		gc_mark((object) p[2]);
+		/* fall through */
+	case SYMBOL_TAG:		     /* the second word is the hash */
+	case WEAK_TABLE_TAG:		     /* ... the count */
+	case CELL_TAG:
+		gc_mark((object) p[1]);
+		break;
+
+	case WEAK_BOX_TAG:
+		remember(&weak_boxes, p);
+		break;
+
+	case EPHEMERON_TAG:
+		if (p[0] & EPHEMERON_BROKEN)
+			break;
+
+		if (is_marked((object) p[1]))
+			gc_mark((object) p[2]);
+		else
+			remember(&ephemerons, p);
+		break;
+	}
+}
+
+static void scan_grey(struct grey *grey)
+{
+	if (grey->from != NULL)
+		scan_vector(grey->p, grey->from);
+	else
+		scan_object(grey->p);
+}
+
+/* returns 1 when there's nothing left to scan */
+static int mark_until(unsigned long deadline)
+{
+	struct grey grey;
+	unsigned long n = 0;
+
+	while (pop_grey(&grey)) {
+		scan_grey(&grey);
+
+		if (++n % 64 == 0 && usecs() >= deadline)
+			return 0;
+	}
+
+	return 1;
+}
+
+
+/* Parallel marking */
+
+/* half of the bottom of a victim's stack, the oldest and likely biggest work */
+static int steal_grey()
+{
+	struct mark_stack *victim;
+	unsigned long i, n;
+
+	for (i = 0; i < gc_threads; i++) {
+		victim = &mark_stacks[i];
+		if (victim == mark_stack || victim->sp == 0)
+			continue;
+
+		/* in address order, thieves may be stealing from each other */
+		pthread_mutex_lock(victim < mark_stack ? &victim->lock : &mark_stack->lock);
+		pthread_mutex_lock(victim < mark_stack ? &mark_stack->lock : &victim->lock);
+
+		n = (victim->sp + 1) / 2;
+
+		stack_reserve(mark_stack, n);
+		memcpy(mark_stack->items + mark_stack->sp, victim->items, n * sizeof(struct grey));
+		memmove(victim->items, victim->items + n, (victim->sp - n) * sizeof(struct grey));
+
+		mark_stack->sp += n;
+		victim->sp     -= n;
+
+		pthread_mutex_unlock(&mark_stack->lock);
+		pthread_mutex_unlock(&victim->lock);
+
+		if (mark_stack->sp > 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int any_grey()
+{
+	unsigned long i;
+
+	for (i = 0; i < gc_threads; i++)
+		if (__atomic_load_n(&mark_stacks[i].sp, __ATOMIC_RELAXED) > 0)
+			return 1;
+
+	return 0;
+}
+
+/* Only idle markers push nothing, so once all are idle every stack is
+   empty and stays that way */
+static void mark_in_parallel()
+{
+	struct grey grey;
+
+	for (;;) {
+		while (pop_grey(&grey))
+			scan_grey(&grey);
+
+		if (steal_grey())
+			continue;
+
+		__atomic_add_fetch(&idle_markers, 1, __ATOMIC_SEQ_CST);
+
+		for (;;) {
+			if (__atomic_load_n(&idle_markers, __ATOMIC_SEQ_CST) == gc_threads)
+				return;
+
+			if (any_grey()) {
+				__atomic_sub_fetch(&idle_markers, 1, __ATOMIC_SEQ_CST);
+				break;
+			}
+
+			sched_yield();
+		}
+	}
+}
+
+static void *marker_thread(void *arg)
+{
+	unsigned long epoch = 0;
+
+	mark_stack = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&markers_lock);
+		while (markers_epoch == epoch)
+			pthread_cond_wait(&markers_start, &markers_lock);
+		epoch = markers_epoch;
+		pthread_mutex_unlock(&markers_lock);
+
+		mark_in_parallel();
+
+		pthread_mutex_lock(&markers_lock);
+		if (++markers_finished == gc_threads - 1)
+			pthread_cond_signal(&markers_done);
+		pthread_mutex_unlock(&markers_lock);
+	}
+
+	return NULL;
+}
+
+static void start_marker_threads()
+{
+	pthread_t thread;
+	unsigned long i;
+
+	for (i = 0; i < gc_threads; i++)
+		pthread_mutex_init(&mark_stacks[i].lock, NULL);
+
+	for (i = 1; i < gc_threads; i++)
+		if (pthread_create(&thread, NULL, marker_thread, &mark_stacks[i]))
+			FATAL("failed to start marker thread");
+}
+
+static void mark_drain()
+{
+	struct grey grey;
+
+	if (gc_threads == 1) {
+		while (pop_grey(&grey))
+			scan_grey(&grey);
+		return;
+	}
+
+	marking_in_parallel = 1;
+	idle_markers = 0;
+
+	pthread_mutex_lock(&markers_lock);
+	markers_finished = 0;
+	markers_epoch++;
+	pthread_cond_broadcast(&markers_start);
+	pthread_mutex_unlock(&markers_lock);
+
+	mark_in_parallel();
+
+	pthread_mutex_lock(&markers_lock);
+	while (markers_finished < gc_threads - 1)
+		pthread_cond_wait(&markers_done, &markers_lock);
+	pthread_mutex_unlock(&markers_lock);
+
+	marking_in_parallel = 0;
+}
+
+static void __attribute__((noinline)) mark_c_stack()
+{
+	mark_range(__builtin_frame_address(0), __libc_stack_end);
+}
+
+#if COMPRESSED_POINTERS
+static void mark_references(object_ref *from, object_ref *to)
+{
+	for (; from < to; from++)
+		if (*from & 2)
+			mark_ambiguous((unsigned long) referenced_object(*from));
+}
+#endif
+
+/* what region objects point to, they aren't marked themselves */
+static void mark_regions()
+{
+	unsigned long i;
+
+	for (i = 0; i < arena_top; i++) {
+		if (chunks[i].depth == 0)
+			continue;
+
+		mark_range(arena + i * GC_CHUNK_WORDS, arena + (i + 1) * GC_CHUNK_WORDS);
+#if COMPRESSED_POINTERS
+		mark_references((object_ref *) (arena + i * GC_CHUNK_WORDS),
+				(object_ref *) (arena + (i + 1) * GC_CHUNK_WORDS));
+#endif
+	}
+}
+
+static void mark_roots()
+{
+	/* spill the callee saved registers into this frame */
+	__builtin_unwind_init();
+
+	mark_c_stack();
+	mark_range(__data_start, _end);
+	mark_regions();
+
+	symbol_table_mark();
+}
+
+/* the ephemerons still waiting for their keys */
+static void mark_ephemerons()
+{
+	unsigned long i, n = 0, *p;
+
+	for (i = 0; i < ephemerons.count; i++) {
+		p = ephemerons.items[i];
+
+		if (is_marked((object) p[1]))
+			gc_mark((object) p[2]);
+		else
+			ephemerons.items[n++] = p;
+	}
+
+	ephemerons.count = n;
+}
+
+static void mark_weak()
+{
+	for (;;) {
+		mark_ephemerons();
+		memo_tables_mark();
+
+		if (!any_grey())
+			break;
+
+		mark_drain();
+	}
+}
+
+static void break_weak()
+{
+	unsigned long i, *p;
+
+	for (i = 0; i < weak_boxes.count; i++) {
+		p = weak_boxes.items[i];
+
+		if (!is_marked((object) p[1]))
+			p[1] = (unsigned long) the_falsity;
+	}
+
+	for (i = 0; i < ephemerons.count; i++) {
+		p = ephemerons.items[i];
+
+		p[0] |= EPHEMERON_BROKEN;
+		p[1]  = p[2] = (unsigned long) the_falsity;
+	}
+
+	weak_boxes.count = ephemerons.count = 0;
+
+	memo_tables_sweep();
+}
+
+
+/* Finalization */
+
+static void finalizer_push(struct finalizer_list *list, struct finalizer *f)
+{
+	if (list->count == list->size) {
+		list->size  = MAX(2 * list->size, 64);
+		list->items = xrealloc(list->items, list->size * sizeof(struct finalizer));
+	}
+
+	list->items[list->count++] = *f;
+}
+
+/* the release functions don't need the objects, they are swept */
+static void queue_finalizers()
+{
+	unsigned long i, n = 0;
+	struct finalizer f;
+
+	for (i = 0; i < finalizable.count; i++) {
+		f = finalizable.items[i];
+
+		if (is_marked(f.o))
+			finalizable.items[n++] = f;
+		else
+			finalizer_push(&finalizers_due, &f);
+	}
+
+	finalizable.count = n;
+	gc_finalizers_pending = finalizers_due.count;
+}
+
+void gc_register_finalizer(object o, void (*release)(void *), void *data)
+{
+	struct finalizer f = { o, release, data };
+
+	/* an arena object would go without being seen dead */
+	assert(!in_arena(object_address(o)));
+
+	finalizer_push(&finalizable, &f);
+}
+
+/* the newest are the likeliest to go first */
+void gc_cancel_finalizer(object o)
+{
+	unsigned long i = finalizable.count;
+
+	while (i-- > 0)
+		if (finalizable.items[i].o == o) {
+			finalizable.items[i] = finalizable.items[--finalizable.count];
+			return;
+		}
+}
+
+/* a release function may well allocate, and start another cycle */
+void gc_run_finalizers()
+{
+	struct finalizer f;
+
+	while (finalizers_due.count > 0) {
+		f = finalizers_due.items[--finalizers_due.count];
+		gc_finalizers_pending = finalizers_due.count;
+
+		f.release(f.data);
+		gc.finalized++;
+	}
+}
+
+
+/* Sweeping */
+
+static void add_free_run(unsigned long n, unsigned long count)
+{
+	unsigned long *p = page_base(n);
+
+	p[0] = (unsigned long) free_runs;
+	p[1] = count;
+	free_runs = p;
+}
+
+static void end_free_run()
+{
+	if (free_run_pages > 0)
+		add_free_run(free_run_start, free_run_pages);
+
+	free_run_pages = 0;
+}
+
+/* pages are swept in order, free ones join the run before them */
+static void sweep_free_page(unsigned long n)
+{
+	pages[n].kind = PAGE_FREE;
+	gc.free += GC_PAGE_WORDS;
+
+	if (free_run_pages++ == 0)
+		free_run_start = n;
+}
+
+static void sweep_small_page(unsigned long n)
+{
+	struct size_class *sc = &classes[pages[n].class];
+	unsigned long *p, *base = page_base(n);
+	unsigned long w, live = 0, slots = GC_PAGE_WORDS / sc->words;
+	long i;
+
+	for (w = word_index(base) / BITS_PER_WORD; w < word_index(base + GC_PAGE_WORDS) / BITS_PER_WORD; w++) {
+		start_bits[w] &= mark_bits[w];
+		mark_bits[w] = 0;
+		live += __builtin_popcountl(start_bits[w]);
+	}
+
+	if (live == 0) {
+		sweep_free_page(n);
+		return;
+	}
+
+	end_free_run();
+
+	/* backwards, so the list comes out in address order */
+	for (i = slots - 1; i >= 0; i--) {
+		p = base + i * sc->words;
+
+		if (!test_bit(start_bits, word_index(p))) {
+			p[0] = (unsigned long) sc->free;
+			sc->free = p;
+		}
+	}
+
+	gc.live += live * sc->words;
+	gc.free += (slots - live) * sc->words;
+}
+
+/* returns the pages it spans */
+static unsigned long sweep_run(unsigned long n)
+{
+	unsigned long i, count = pages[n].pages;
+	unsigned long *p = page_base(n);
+
+	if (test_bit(mark_bits, word_index(p))) {
+		clear_bit(mark_bits, word_index(p));
+		end_free_run();
+		gc.live += count * GC_PAGE_WORDS;
+	} else {
+		clear_bit(start_bits, word_index(p));
+		for (i = 0; i < count; i++)
+			sweep_free_page(n + i);
+	}
+
+	return count;
+}
+
+/* all at once, there are few of them */
+static void sweep_large_objects()
+{
+	struct large_object *lo;
+	unsigned long i, n = 0;
+
+	large.live = 0;
+	large.low  = large.high = NULL;
+
+	for (i = 0; i < large.count; i++) {
+		lo = &large.objects[i];
+
+		if (!lo->marked) {
+			munmap(lo->p, lo->bytes);
+			large.mapped -= lo->bytes;
+			continue;
+		}
+
+		lo->marked = 0;
+		large.live += lo->bytes;
+
+		if (n == 0)
+			large.low = lo->p;
+		large.high = lo->p + lo->words;
+
+		large.objects[n++] = *lo;
+	}
+
+	large.count = n;
+	large.since = 0;
+}
+
+static void sweep_begin()
+{
+	unsigned long i;
+
+	sweep_large_objects();
+
+	phase = GC_SWEEPING;
+
+	/* rebuilt as the sweep goes */
+	for (i = 0; i < GC_CLASSES; i++)
+		classes[i].free = classes[i].bump = classes[i].bump_end = NULL;
+
+	free_runs      = NULL;
+	free_run_pages = 0;
+
+	sweep_page = 0;
+	gc.live    = 0;
+	gc.free    = 0;
+}
+
+static void sweep_end()
+{
+	end_free_run();
+
+	phase = GC_IDLE;
+	gc.collections++;
+
+	/* the next cycle should be over before this fills up */
+	gc.trigger   = gc_pause_budget ? gc.allocated + gc.free / 2 : ~0UL;
+	gc.countdown = 0;
+}
+
+/* returns 1 when the whole heap has been swept */
+static int sweep_pages(unsigned long n)
+{
+	unsigned long end = MIN(sweep_page + n, page_count);
+
+	while (sweep_page < end) {
+		switch (pages[sweep_page].kind) {
+		case PAGE_FREE:
+			sweep_free_page(sweep_page++);
+			break;
+
+		case PAGE_RUN:
+			sweep_page += sweep_run(sweep_page);
+			break;
+
+		default:
+			sweep_small_page(sweep_page++);
+			break;
+		}
+	}
+
+	if (sweep_page < page_count)
+		return 0;
+
+	sweep_end();
+	return 1;
+}
+
+
+/* Cycles */
+
+static void mark_begin()
+{
+	phase = GC_MARKING;
+	gc_marking = 1;
+
+	mark_roots();
+}
+
+/* the stack and the tables have no barrier, look at them again */
+static void mark_finish()
+{
+	mark_roots();
+	mark_drain();
+	mark_weak();
+	break_weak();
+	queue_finalizers();
+
+	gc_marking = 0;
+	sweep_begin();
+}
+
+static void collect_all()
+{
+	if (phase == GC_SWEEPING)
+		sweep_pages(page_count);
+
+	if (phase == GC_IDLE)
+		mark_begin();
+
+	mark_drain();
+	mark_finish();
+	sweep_pages(page_count);
+}
+
+static void record_pause(unsigned long start)
+{
+	unsigned long pause = usecs() - start;
+	unsigned long bucket = 0;
+
+	gc.usecs    += pause;
+	gc.max_pause = MAX(gc.max_pause, pause);
+
+	while (bucket < GC_PAUSE_BUCKETS - 1 && (1UL << bucket) <= pause)
+		bucket++;
+
+	gc.pauses[bucket]++;
+}
+
+/* one increment of an incremental cycle */
+static void gc_step()
+{
+	unsigned long start = usecs();
+	unsigned long deadline = start + gc_pause_budget;
+
+	switch (phase) {
+	case GC_IDLE:
+		mark_begin();
+		break;
+
+	case GC_MARKING:
+		if (mark_until(deadline))
+			mark_finish();
+		break;
+
+	case GC_SWEEPING:
+		while (!sweep_pages(GC_SWEEP_PAGES) && usecs() < deadline)
+			;
+		break;
+	}
+
+	record_pause(start);
+}
+
+/* an allocation failed */
+static void gc_make_room()
+{
+	unsigned long start = usecs();
+
+	if (phase == GC_SWEEPING) {
+		sweep_pages(GC_SWEEP_PAGES);
+	} else {
+		if (phase == GC_MARKING)
+			gc.forced++;
+
+		collect_all();
+	}
+
+	record_pause(start);
+}
+
+/* a cycle already marking keeps whatever was allocated since it began,
+   finish it and do a whole one */
+void gc_collect()
+{
+	unsigned long start = usecs();
+
+	if (phase == GC_MARKING)
+		collect_all();
+
+	collect_all();
+	record_pause(start);
+}
+
+
+/* Allocation */
+
+/* first fit, the rest of the run stays free */
+static unsigned long *take_pages(unsigned long count)
+{
+	unsigned long *p, **prev, n;
+
+	for (prev = &free_runs; (p = *prev) != NULL; prev = (unsigned long **) &p[0]) {
+		n = p[1];
+		if (n < count)
+			continue;
+
+		*prev = (unsigned long *) p[0];
+
+		if (n > count)
+			add_free_run(page_index(p) + count, n - count);
+
+		return p;
+	}
+
+	return NULL;
+}
+
+static unsigned long *take_slot(unsigned long class)
+{
+	struct size_class *sc = &classes[class];
+	unsigned long *p, n;
+
+	if ((p = sc->free) != NULL) {
+		sc->free = (unsigned long *) p[0];
+		return p;
+	}
+
+	if (sc->bump_end - sc->bump < (long) sc->words) {
+		if ((p = take_pages(1)) == NULL)
+			return NULL;
+
+		n = page_index(p);
+		pages[n].kind  = class == PAIR_CLASS ? PAGE_PAIRS : PAGE_SMALL;
+		pages[n].class = class;
+
+		sc->bump     = p;
+		sc->bump_end = p + GC_PAGE_WORDS;
+	}
+
+	p = sc->bump;
+	sc->bump += sc->words;
+	return p;
+}
+
+static unsigned long *take_run(unsigned long words)
+{
+	unsigned long i, n, count = (words + GC_PAGE_WORDS - 1) / GC_PAGE_WORDS;
+	unsigned long *p;
+
+	if ((p = take_pages(count)) == NULL)
+		return NULL;
+
+	n = page_index(p);
+	pages[n].kind  = PAGE_RUN;
+	pages[n].pages = count;
+
+	for (i = 1; i < count; i++) {
+		pages[n + i].kind  = PAGE_RUN_TAIL;
+		pages[n + i].pages = i;
+	}
+
+	return p;
+}
+
+static unsigned long *alloc_words(unsigned long words, unsigned long class)
+{
+	unsigned long *p, collections = gc.collections;
+
+	if ((phase != GC_IDLE || gc.allocated >= gc.trigger) && gc.countdown-- == 0) {
+		gc.countdown = GC_SLICE_ALLOCATIONS;
+		gc_step();
+	}
+
+	while ((p = class == RUN_CLASS ? take_run(words) : take_slot(class)) == NULL) {
+		/* a cycle already going may have missed some garbage, give it another */
+		if (phase == GC_IDLE && gc.collections >= collections + 2)
+			FATAL("Out of memory, allocating %lu words\n", words);
+
+		gc_make_room();
+	}
+
+	set_bit(start_bits, word_index(p));
+	gc.allocated += words;
+
+	/* grey, scanned after the caller has filled it in */
+	if (phase == GC_MARKING)
+		mark_start(p);
+
+	return p;
+}
+
+static unsigned long *alloc_large(unsigned long words)
+{
+	struct large_object *lo;
+	unsigned long i, limit, page = sysconf(_SC_PAGESIZE);
+	size_t bytes = (words * sizeof(unsigned long) + page - 1) & ~(page - 1);
+	void *p;
+
+	/* mappings count against the heap size too, or twice what survived */
+	limit = MAX(heap_size, 2 * large.live);
+
+	if (gc_pause_budget == 0) {
+		if (large.since >= limit)
+			gc_collect();
+	} else if (large.since >= 2 * limit) {
+		/* the increments don't keep up */
+		gc.forced++;
+		gc_collect();
+	} else if (large.since >= limit || phase != GC_IDLE) {
+		gc_step();
+	}
+
+	if ((p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		gc_collect();
+
+		if ((p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+			FATAL("Out of memory, mapping %lu words\n", words);
+	}
+
+	if (large.count == large.size) {
+		large.size    = large.size ? 2 * large.size : 64;
+		large.objects = xrealloc(large.objects, large.size * sizeof(struct large_object));
+	}
+
+	for (i = large.count; i > 0 && large.objects[i - 1].p > (unsigned long *) p; i--)
+		large.objects[i] = large.objects[i - 1];
+
+	lo = &large.objects[i];
+	lo->p      = p;
+	lo->words  = words;
+	lo->bytes  = bytes;
+	lo->marked = 0;
+	large.count++;
+
+	if (large.low == NULL || lo->p < large.low)
+		large.low = lo->p;
+	if (lo->p + words > large.high)
+		large.high = lo->p + words;
+
+	large.mapped += bytes;
+	large.since  += bytes;
+	gc.allocated += words;
+
+	/* allocated black, scanning a fresh mapping would only find what
+	   the constructors shade as they store it */
+	if (phase == GC_MARKING)
+		lo->marked = 1;
+
+	return p;
+}
+
+static unsigned long *region_alloc(unsigned long words);
+
+unsigned long *gc_alloc(unsigned long words)
+{
+	if (gc_region_depth > 0)
+		return region_alloc(words);
+
+	if (words >= GC_LARGE_WORDS)
+		return alloc_large(words);
+
+	return alloc_words(words, words <= GC_SMALL_WORDS ? class_of[words] : RUN_CLASS);
+}
+
+unsigned long *gc_alloc_pair()
+{
+	if (gc_region_depth > 0)
+		return region_alloc(PAIR_WORDS);
+
+	return alloc_words(PAIR_WORDS, PAIR_CLASS);
+}
+
+
+/* Regions */
+
+/* first fit, owned by the current region */
+static unsigned long *take_chunks(unsigned long count)
+{
+	struct region *r = &regions[gc_region_depth];
+	unsigned long i, start;
+
+	for (start = i = 0; i < arena_top && i - start < count; i++)
+		if (chunks[i].depth > 0)
+			start = i + 1;
+
+	if (start + count > GC_ARENA_CHUNKS)
+		error("Out of region memory -- WITH-REGION", nil);
+
+	arena_top = MAX(arena_top, start + count);
+
+	for (i = start; i < start + count; i++)
+		chunks[i].depth = gc_region_depth;
+
+	chunks[start].count = count;
+	chunks[start].next  = r->chunks;
+	r->chunks = start;
+
+	chunks_in_use += count;
+	region_stats.most_chunks = MAX(region_stats.most_chunks, chunks_in_use);
+
+	return arena + start * GC_CHUNK_WORDS;
+}
+
+static unsigned long *region_alloc(unsigned long words)
+{
+	struct region *r = &regions[gc_region_depth];
+	unsigned long *p;
+
+	region_stats.allocated += words;
+
+	if (r->end - r->bump < (long) words) {
+		/* bigger than a chunk, a run of its own */
+		if (words > GC_CHUNK_WORDS)
+			return take_chunks((words + GC_CHUNK_WORDS - 1) / GC_CHUNK_WORDS);
+
+		r->bump = take_chunks(1);
+		r->end  = r->bump + GC_CHUNK_WORDS;
+	}
+
+	p = r->bump;
+	r->bump += words;
+	return p;
+}
+
+/* the region an object was allocated in, 0 for the heap */
+static unsigned long region_of(object o)
+{
+	unsigned long *p = object_address(o);
+
+	if (p == NULL || !in_arena(p))
+		return 0;
+
+	return chunks[(p - arena) / GC_CHUNK_WORDS].depth;
+}
+
+void gc_region_check(object container, object o)
+{
+	if (region_of(o) > region_of(container))
+		error("Object would outlive its region -- WITH-REGION", o);
+}
+
+/* address space only, backed as it gets used */
+static void *map_reserve(size_t bytes)
+{
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (p == MAP_FAILED)
+		FATAL("failed to map %lu bytes\n", (unsigned long) bytes);
+
+	return p;
+}
+
+static void arena_init(unsigned long *at)
+{
+	arena     = at;
+	arena_end = arena + GC_ARENA_CHUNKS * GC_CHUNK_WORDS;
+	chunks    = xcalloc(GC_ARENA_CHUNKS, sizeof(struct chunk));
+}
+
+void gc_region_enter()
+{
+	struct region *r;
+
+	if (gc_region_depth == GC_MAX_REGIONS)
+		error("Regions nested too deeply -- WITH-REGION", nil);
+
+	if (arena == NULL)
+		arena_init(map_reserve(GC_ARENA_BYTES));
+
+	r = &regions[++gc_region_depth];
+	r->bump   = r->end = NULL;
+	r->chunks = -1;
+
+	region_stats.entered++;
+}
+
+static inline unsigned long forward_slot(object o)
+{
+	unsigned long mask = forwards.size - 1;
+	unsigned long i = ((unsigned long) o >> 3) * 2654435761UL & mask;
+
+	while (forwards.from[i] != NULL && forwards.from[i] != o)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static object forwarded(object o)
+{
+	return forwards.size > 0 ? forwards.to[forward_slot(o)] : NULL;
+}
+
+static void forward(object from, object to)
+{
+	object *old_from = forwards.from, *old_to = forwards.to;
+	unsigned long i, size = forwards.size;
+
+	if (2 * (forwards.count + 1) > forwards.size) {
+		forwards.size  = size ? 2 * size : 256;
+		forwards.from  = xcalloc(forwards.size, sizeof(object));
+		forwards.to    = xcalloc(forwards.size, sizeof(object));
+		forwards.count = 0;
+
+		for (i = 0; i < size; i++)
+			if (old_from[i] != NULL)
+				forward(old_from[i], old_to[i]);
+
+		xfree(old_from);
+		xfree(old_to);
+	}
+
+	i = forward_slot(from);
+	forwards.from[i] = from;
+	forwards.to[i]   = to;
+	forwards.count++;
+}
+
+static void forwards_clear()
+{
+	xfree(forwards.from);
+	xfree(forwards.to);
+	memset(&forwards, 0, sizeof(forwards));
+}
+
+static object copy_out(object o, unsigned long depth);
+
+/* iterative along the cdrs, lists can be long */
+static object copy_list(object o, unsigned long depth)
+{
+	object head, tail;
+
+	head = tail = cons(nil, nil);
+	forward(o, head);
+
+	for (;;) {
+		set_car(tail, copy_out(car(o), depth));
+		region_stats.copied += PAIR_WORDS;
+
+		o = cdr(o);
+		if (!is_pair(o) || region_of(o) != depth || forwarded(o) != NULL)
+			break;
+
+		set_cdr(tail, cons(nil, nil));
+		tail = cdr(tail);
+		forward(o, tail);
+	}
+
+	set_cdr(tail, copy_out(o, depth));
+	return head;
+}
+
+/* what was allocated in the region at depth, to wherever allocation
+   goes now, sharing and cycles kept */
+static object copy_out(object o, unsigned long depth)
+{
+	unsigned long i, n, words, *p, *q;
+	object copy, field;
+
+	if (region_of(o) != depth)
+		return o;
+
+	if ((copy = forwarded(o)) != NULL)
+		return copy;
+
+	if (is_pair(o))
+		return copy_list(o, depth);
+
+	p     = object_address(o);
+	words = header_words(p[0]);
+
+	q = gc_alloc(words);
+	memcpy(q, p, words * sizeof(unsigned long));
+	region_stats.copied += words;
+
+	copy = (object) ((unsigned long) q | INDIRECT_TAG);
+	forward(o, copy);
+
+	if (is_vector(copy)) {
+		for (i = 0, n = vector_length(copy); i < n; i++)
+			vector_set(copy, i, copy_out(vector_ref(copy, i), depth));
+
+		return copy;
+	}
+
+	for (i = 1, n = pointer_words(q[0]); i < n; i++) {
+		field = copy_out((object) q[i], depth);
+		gc_write_barrier(copy, field);
+		q[i] = (unsigned long) field;
+	}
+
+	return copy;
+}
+
+static void release_chunks(struct region *r)
+{
+	unsigned long i;
+	long c;
+
+	for (c = r->chunks; c >= 0; c = chunks[c].next) {
+		for (i = 0; i < chunks[c].count; i++)
+			chunks[c + i].depth = 0;
+
+		chunks_in_use -= chunks[c].count;
+	}
+}
+
+object gc_region_exit(object result)
+{
+	unsigned long depth = gc_region_depth--;
+
+	/* the chunks stay owned, and scanned, until the copy is done */
+	result = copy_out(result, depth);
+	forwards_clear();
+
+	release_chunks(&regions[depth]);
+	return result;
+}
+
+void gc_region_abandon()
+{
+	unsigned long i;
+
+	for (i = 0; i < arena_top; i++)
+		chunks[i].depth = 0;
+
+	chunks_in_use   = 0;
+	gc_region_depth = 0;
+	forwards_clear();
+}
+
+unsigned long gc_region_suspend()
+{
+	unsigned long depth = gc_region_depth;
+
+	gc_region_depth = 0;
+	return depth;
+}
+
+void gc_region_resume(unsigned long depth)
+{
+	gc_region_depth = depth;
+}
+
+
+void gc_init(unsigned long size)
+{
+	unsigned long i, n, words;
+
+	page_count = MAX(size / sizeof(unsigned long) / GC_PAGE_WORDS, 1);
+	words      = page_count * GC_PAGE_WORDS;
+
+#if COMPRESSED_POINTERS
+	/* the arena right after the heap, both within reach of references */
+	if (words * sizeof(unsigned long) + GC_ARENA_BYTES > (1UL << 32))
+		FATAL("heap too big for 32 bit references\n");
+
+	gc_window = map_reserve(words * sizeof(unsigned long) + GC_ARENA_BYTES);
+	heap      = (unsigned long *) gc_window;
+
+	arena_init(heap + words);
+#else
+	if (posix_memalign((void **) &heap, GC_PAGE_WORDS * sizeof(unsigned long), words * sizeof(unsigned long)))
+		FATAL("failed to allocate heap");
+#endif
+
+	heap_end = heap + words;
+
+	start_bits = xcalloc(words / BITS_PER_WORD, sizeof(unsigned long));
+	mark_bits  = xcalloc(words / BITS_PER_WORD, sizeof(unsigned long));
+
+	pages = xcalloc(page_count, sizeof(struct page));
+	add_free_run(0, page_count);
+
+	for (i = 0; i < GC_CLASSES; i++)
+		classes[i].words = class_words[i];
+
+	/* the smallest class that fits, the pair class is left out */
+	for (n = 1, i = 1; n <= GC_SMALL_WORDS; n++) {
+		while (class_words[i] < n)
+			i++;
+
+		class_of[n] = i;
+	}
+
+	gc.trigger = gc_pause_budget ? words / 2 : ~0UL;
+
+	gc_threads = MIN(MAX(gc_threads, 1), GC_MAX_THREADS);
+	if (gc_threads > 1)
+		start_marker_threads();
+}
+
+unsigned long gc_allocated_bytes()
+{
+	return gc.allocated * sizeof(unsigned long);
+}
+
+void gc_stats()
+{
+	unsigned long i, kinds[PAGE_RUN_TAIL + 1] = { 0 };
+
+	fprintf(stderr, "Allocated %lu heap bytes.\n", gc.allocated * sizeof(unsigned long));
+
+	for (i = 0; i < page_count; i++)
+		kinds[pages[i].kind]++;
+
+	fprintf(stderr, "Pages: %lu, %lu of pairs, %lu of small objects, %lu in runs, %lu free\n",
+		page_count, kinds[PAGE_PAIRS], kinds[PAGE_SMALL],
+		kinds[PAGE_RUN] + kinds[PAGE_RUN_TAIL], kinds[PAGE_FREE]);
+
+	if (region_stats.entered > 0)
+		fprintf(stderr, "Regions: %lu entered, %lu bytes allocated in them, %lu copied out, %lu chunks at most\n",
+			region_stats.entered, region_stats.allocated * sizeof(unsigned long),
+			region_stats.copied * sizeof(unsigned long), region_stats.most_chunks);
+
+	if (gc.collections == 0)
+		return;
+
+	fprintf(stderr, "Collections: %lu (%lu finished at once), %lu bytes live after the last\n",
+		gc.collections, gc.forced, gc.live * sizeof(unsigned long));
+	fprintf(stderr, "Large objects: %lu, %lu bytes mapped, %lu live after the last\n",
+		large.count, large.mapped, large.live);
+	if (gc.finalized > 0)
+		fprintf(stderr, "Finalized: %lu objects, %lu registered\n",
+			gc.finalized, finalizable.count);
+	fprintf(stderr, "Pauses: %lu ms total, %lu us longest\n",
+		gc.usecs / 1000, gc.max_pause);
+
+	for (i = 0; i < GC_PAUSE_BUCKETS; i++)
+		if (gc.pauses[i] > 0)
+			fprintf(stderr, "    < %8lu us: %lu\n", 1UL << i, gc.pauses[i]);
+}
@@ -0,0 +1,64 @@
+#ifndef __GC_H
+#define __GC_H
+
+extern unsigned long gc_pause_budget;
+extern unsigned long gc_threads;	     /* marking all at once */
+
+extern void gc_init(unsigned long size);
+
+/* uninitialized, the caller stores the header (or the car and cdr) */
+extern unsigned long *gc_alloc(unsigned long words);
+extern unsigned long *gc_alloc_pair();
+
+extern void gc_collect();
+
+/* for roots kept outside the heap, C stack and data segment */
+extern void gc_mark(object o);
+
+/* while a cycle finishes, whether o has been marked (or can't be collected) */
+extern int gc_is_live(object o);
+
+extern int gc_marking;
+
+#if COMPRESSED_POINTERS
+extern char *gc_window;			     /* what references are offsets from */
+#endif
+
+/* Once o is found unreachable, release(data) is queued, and called by
+   gc_run_finalizers. Nothing is run from inside the collector. */
+extern void gc_register_finalizer(object o, void (*release)(void *), void *data);
+extern void gc_cancel_finalizer(object o);
+extern void gc_run_finalizers();
+
+extern unsigned long gc_finalizers_pending;
+
+/* Allocation inside a region goes to an arena dropped whole on exit.
+   Only the result survives, copied out to the enclosing region or the
+   heap. Nesting depth 0 is the heap. */
+extern unsigned long gc_region_depth;
+
+extern void   gc_region_enter();
+extern object gc_region_exit(object result);
+extern void   gc_region_abandon();	     /* after an error */
+
+/* for objects that have to outlive any region */
+extern unsigned long gc_region_suspend();
+extern void gc_region_resume(unsigned long depth);
+
+extern void gc_region_check(object container, object o);
+
+/* the collector has to see what is stored into the heap while it
+   marks, and nothing may keep a region object past its exit */
+static inline void gc_write_barrier(object container, object o)
+{
+	if (gc_marking)
+		gc_mark(o);
+
+	if (gc_region_depth > 0)
+		gc_region_check(container, o);
+}
+
+extern unsigned long gc_allocated_bytes();
+extern void gc_stats();
+
+#endif
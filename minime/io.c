@@ -3,120 +3,189 @@
 #include <string.h>
 #include <ctype.h>
 #include <setjmp.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <assert.h>
 
 #include "minime.h"
 
 #define STRING_MIN_BUFFER         128
-#define STRING_REALLOC_INCREMENT 1024
 
-static int peek_char(FILE *in)
+/* The reader works on the port's buffer directly. Tokens are scanned
+   there by character class, and only gathered elsewhere when they run
+   past its end. */
+
+#define CC_SPACE      0x01
+#define CC_DELIMITER  0x02
+#define CC_INITIAL    0x04
+#define CC_SUBSEQUENT 0x08
+#define CC_UPPER      0x10
+#define CC_NUMBER     0x20		     /* prefixes, signs and digits */
+
+#define CC_LETTER     (CC_INITIAL | CC_SUBSEQUENT | CC_NUMBER)
+#define CC_SPECIAL    (CC_INITIAL | CC_SUBSEQUENT)
+
+static const unsigned char char_class[256] = {
+	[' ']  = CC_SPACE | CC_DELIMITER,
+	['\t'] = CC_SPACE | CC_DELIMITER,
+	['\n'] = CC_SPACE | CC_DELIMITER,
+	['\v'] = CC_SPACE | CC_DELIMITER,
+	['\f'] = CC_SPACE | CC_DELIMITER,
+	['\r'] = CC_SPACE | CC_DELIMITER,
+
+	['(']  = CC_DELIMITER,
+	[')']  = CC_DELIMITER,
+	['"']  = CC_DELIMITER,
+	[';']  = CC_DELIMITER,
+
+	['a' ... 'z'] = CC_LETTER,
+	['A' ... 'Z'] = CC_LETTER | CC_UPPER,
+	['0' ... '9'] = CC_SUBSEQUENT | CC_NUMBER,
+
+	['!'] = CC_SPECIAL, ['$'] = CC_SPECIAL, ['%'] = CC_SPECIAL,
+	['&'] = CC_SPECIAL, ['*'] = CC_SPECIAL, ['/'] = CC_SPECIAL,
+	[':'] = CC_SPECIAL, ['<'] = CC_SPECIAL, ['='] = CC_SPECIAL,
+	['>'] = CC_SPECIAL, ['?'] = CC_SPECIAL, ['^'] = CC_SPECIAL,
+	['_'] = CC_SPECIAL, ['~'] = CC_SPECIAL,
+
+	['+'] = CC_SUBSEQUENT | CC_NUMBER,
+	['-'] = CC_SUBSEQUENT | CC_NUMBER,
+	['.'] = CC_SUBSEQUENT | CC_NUMBER,
+	['@'] = CC_SUBSEQUENT,
+	['#'] = CC_NUMBER,
+};
+
+#define char_is(c, cls) ((c) != EOF && (char_class[(unsigned char) (c)] & (cls)))
+
+static int is_delimiter(int c)
 {
-	int c = fgetc(in);
-	ungetc(c, in);
-	return c;
+	return c == EOF || char_is(c, CC_DELIMITER);
 }
 
-static void skip_atmospheric(FILE *in)
+/* there is nothing to put back after EOF */
+static void unread_char(struct port *in, int c)
 {
-	int c;
+	if (c != EOF)
+		port_ungetc(in);
+}
 
-	while ((c = fgetc(in)) != EOF) {
+/* whitespace and comments, the end of a comment is found with memchr */
+static void skip_atmospheric(struct port *in)
+{
+	unsigned char *p, *end, *nl;
+	int in_comment = 0;
 
-		if (isspace(c))
-			continue;
+	while (in->start < in->end || port_fill(in)) {
+		p   = in->buffer + in->start;
+		end = in->buffer + in->end;
 
-		if (c == ';') {
-			while (c != EOF && c != '\n') {
-				c = fgetc(in);
+		if (in_comment) {
+			if ((nl = memchr(p, '\n', end - p)) == NULL) {
+				in->start = in->end;
+				continue;
 			}
-			continue;
+
+			p = nl + 1;
+			in_comment = 0;
 		}
 
-		break;
-	}
-	ungetc(c, in);
-}
+		while (p < end && (char_class[*p] & CC_SPACE))
+			p++;
 
-static int is_delimiter(int c)
-{
-	return isspace(c) || c == EOF ||
-		c == '('  || c == ')' ||
-		c == '"'  || c == ';';
-}
+		in->start = p - in->buffer;
 
-static int is_special_initial(int c)
-{
-	return strchr("!$%&*/:<=>?^_~", c) ? 1 : 0;
-}
+		if (p == end)
+			continue;
 
-static int is_initial(int c)
-{
-	return isalpha(c) || is_special_initial(c);
-}
+		if (*p != ';')
+			return;
 
-static int is_special_subsequent(int c)
-{
-	return strchr("+-.@", c) ? 1 : 0;
+		in->start++;
+		in_comment = 1;
+	}
 }
 
-static int is_subsequent(int c)
+/* tokens that don't fit in the port buffer */
+static char *scratch;
+static unsigned long scratch_size;
+
+static void scratch_reserve(unsigned long size)
 {
-	return  is_initial(c) || isdigit(c) ||
-		is_special_subsequent(c);
+	if (size > scratch_size) {
+		scratch_size = MAX(2 * scratch_size, MAX(size, STRING_MIN_BUFFER));
+		scratch = xrealloc(scratch, scratch_size);
+	}
 }
 
-/* this doesn't read the peculiar identifiers, they are scanned in the
- * main reader body */
-static object read_identifier(FILE *in)
+/* The characters of class cls from the current one on, in the port
+   buffer if they end before it does, or else in the scratch buffer.
+   Either way, they stay there until the next read. */
+static char *scan_token(struct port *in, unsigned char cls, unsigned long *len)
 {
-	object o;
-	int str_len = 0;
-	int str_size = STRING_MIN_BUFFER;
-	char *buffer;
-	int c;
-
-	buffer = xmalloc(str_size);
+	unsigned char *p, *q, *end;
+	unsigned long n = 0;
 
-	c = tolower(fgetc(in));
-	assert(is_initial(c));
+	while (1) {
+		p   = in->buffer + in->start;
+		end = in->buffer + in->end;
 
-	buffer[str_len++] = c;
+		for (q = p; q < end && (char_class[*q] & cls); q++)
+			;
 
-	while (1) {
-		c = fgetc(in);
+		in->start = q - in->buffer;
 
-		if (is_delimiter(c)) {
-			ungetc(c, in);
-			break;
+		if (q < end && n == 0) {
+			*len = q - p;
+			return (char *) p;
 		}
 
-		if (!is_subsequent(c))
-			error("Symbol has bad name -- read", nil);
+		scratch_reserve(n + (q - p));
+		memcpy(scratch + n, p, q - p);
+		n += q - p;
 
-		/* we're a lower case scheme */
-		buffer[str_len++] = tolower(c);
+		if (q < end || !port_fill(in)) {
+			*len = n;
+			return scratch;
+		}
 	}
+}
+
+/* this doesn't read the peculiar identifiers, they are scanned in the
+ * main reader body */
+static object read_identifier(struct port *in)
+{
+	unsigned long len, i;
+	char *name;
+
+	name = scan_token(in, CC_SUBSEQUENT, &len);
+	assert(len > 0 && char_is(name[0], CC_INITIAL));
+
+	if (!is_delimiter(port_peekc(in)))
+		error("Symbol has bad name -- read", nil);
 
-	o = make_symbol(buffer, str_len);
-	xfree(buffer);
+	/* we're a lower case scheme */
+	for (i = 0; i < len; i++)
+		if (char_is(name[i], CC_UPPER))
+			name[i] += 'a' - 'A';
 
-	return o;
+	return make_symbol(name, len);
 }
 
-static void peek_char_expect_delimiter(FILE *in)
+static void peek_char_expect_delimiter(struct port *in)
 {
-	if (!is_delimiter(peek_char(in)))
+	if (!is_delimiter(port_peekc(in)))
 		error("Expecting delimiter -- read", nil);
 }
 
-static void expect_string(FILE *in, char *str)
+static void expect_string(struct port *in, char *str)
 {
 	int c;
 
 	while (*str) {
-		c = fgetc(in);
+		c = port_getc(in);
 		if (tolower(c) != *str)
 			error("Unexpected character -- read", nil);
 
@@ -124,9 +193,9 @@ static void expect_string(FILE *in, char *str)
 	}
 }
 
-static object read_character(FILE *in)
+static object read_character(struct port *in)
 {
-	int c = fgetc(in);
+	int c = port_getc(in);
 
 	switch (c) {
 	case EOF:
@@ -135,7 +204,7 @@ static object read_character(FILE *in)
 
 	case 's':
 	case 'S':
-		if (tolower(peek_char(in)) == 'p') {
+		if (tolower(port_peekc(in)) == 'p') {
 			expect_string(in, "pace");
 			peek_char_expect_delimiter(in);
 			return make_character(' ');
@@ -144,7 +213,7 @@ static object read_character(FILE *in)
 
 	case 'n':
 	case 'N':
-		if (tolower(peek_char(in)) == 'e') {
+		if (tolower(port_peekc(in)) == 'e') {
 			expect_string(in, "ewline");
 			peek_char_expect_delimiter(in);
 			return make_character('\n');
@@ -171,61 +240,67 @@ static int is_digit_for_base(int c, int base)
 	return 0;
 }
 
-static object read_string(FILE *in)
+static object read_string(struct port *in)
 {
+	unsigned char *p, *quote;
+	unsigned long len = 0;
 	object o;
-	int str_len = 0;
-	int str_size = STRING_MIN_BUFFER;
-	char *buffer;
 	int c, nextc;
 
-	buffer = xmalloc(str_size);
+	/* most strings have no escapes and are all in the buffer */
+	p = in->buffer + in->start;
+	quote = memchr(p, '"', in->end - in->start);
+
+	if (quote != NULL && memchr(p, '\\', quote - p) == NULL) {
+		o = make_string_buffer((char *) p, quote - p);
+		in->start = quote + 1 - in->buffer;
+
+		peek_char_expect_delimiter(in);
+		return o;
+	}
 
 	while (1) {
-		c = fgetc(in);
+		c = port_getc(in);
 
 		if (c == '"' || c == EOF)
 			break;
 
-		if (str_len == str_size) {
-			str_size += STRING_REALLOC_INCREMENT;
-			buffer = xrealloc(buffer, str_size);
-		}
+		scratch_reserve(len + 1);
 
 		if (c == '\\') {
-			nextc = peek_char(in);
+			nextc = port_peekc(in);
 
 			if (nextc == '\\' || nextc == '"') {
-				buffer[str_len++] = nextc;
-				c = fgetc(in);
+				scratch[len++] = nextc;
+				c = port_getc(in);
 			}
 			/* r5rs doesn't say what to do with the others */
 			else if (nextc == 'n') {
-				buffer[str_len++] = '\n';
-				c = fgetc(in);
+				scratch[len++] = '\n';
+				c = port_getc(in);
 			}
 			else {
 				/* copy the '\\' */
-				buffer[str_len++] = '\\';
+				scratch[len++] = '\\';
 			}
 		}
 		else {
-			buffer[str_len++] = c;
+			scratch[len++] = c;
 		}
 	}
 
 	peek_char_expect_delimiter(in);
-	o = make_string_buffer(buffer, str_len);
-	xfree(buffer);
-
-	return o;
+	return make_string_buffer(scratch, len);
 }
 
-static object read_number(FILE *in)
+static object read_number(struct port *in)
 {
 	int base = 10, exact = 1, sign = 1;
 	int c;
 
+	unsigned long len, i = 0;
+	char *token;
+
 	int at_prefix = 1;
 	int radix_was_set = 0;
 	int exactness_was_set = 0;
@@ -235,8 +310,14 @@ static object read_number(FILE *in)
 
 	long number = 0;
 
+	/* the whole of it, then taken apart */
+	token = scan_token(in, CC_NUMBER, &len);
+
+	if (!is_delimiter(port_peekc(in)))
+		error("Ill-formed number -- read", nil);
+
 	while (1) {
-		c = tolower(fgetc(in));
+		c = (i < len) ? tolower(token[i++]) : EOF;
 
 		if (at_prefix && strchr("bodx", c)) {
 			if (radix_was_set)
@@ -248,8 +329,8 @@ static object read_number(FILE *in)
 
 			radix_was_set = 1;
 
-			if (peek_char(in) == '#')
-				c = fgetc(in);
+			if (i < len && token[i] == '#')
+				i++;
 			else
 				at_prefix = 0;
 
@@ -262,8 +343,8 @@ static object read_number(FILE *in)
 
 			exact = (c == 'e') ? 1 : 0;
 			exactness_was_set = 1;
-			if (peek_char(in) == '#')
-				c = fgetc(in);
+			if (i < len && token[i] == '#')
+				i++;
 			else
 				at_prefix = 0;
 
@@ -288,407 +369,773 @@ static object read_number(FILE *in)
 			continue;
 		}
 
-		if (digits_were_seen && is_delimiter(c)) {
-			ungetc(c, in);
+		if (digits_were_seen && c == EOF)
 			return make_fixnum(sign * number);
-		}
 
 		error("Ill-formed number -- read", nil);
 	}
 }
 
 
-object read_pair(FILE *in)
+/* what the reader finds, apart from whole data */
+enum token {
+	TOKEN_DATUM, TOKEN_OPEN, TOKEN_OPEN_VECTOR, TOKEN_OPEN_BYTEVECTOR, TOKEN_CLOSE,
+	TOKEN_DOT, TOKEN_PREFIX, TOKEN_SKIP, TOKEN_LABEL, TOKEN_REFERENCE,
+	TOKEN_EOF
+};
+
+static enum token read_token(struct port *in, object *datum)
 {
-	object the_car, the_cdr;
+	long n;
 	int c;
 
 	skip_atmospheric(in);
 
-	/* the empty list */
-	c = fgetc(in);
-	if (c == ')')
-		return nil;
-	ungetc(c, in);
-
-	the_car = lisp_read(in);
+	if ((c = port_getc(in)) == EOF)
+		return TOKEN_EOF;
 
-	skip_atmospheric(in);
+	/* characters, booleans or numbers with radix */
+	if (c == '#') {
+		c = port_getc(in);
 
-	c = fgetc(in);
-	/* improper list ? */
-	if (c == '.') {
+		switch (c) {
+		/* number prefixes */
+		case 'b':
+		case 'B':
+		case 'o':
+		case 'O':
+		case 'x':
+		case 'X':
+		case 'd':
+		case 'D':
+		case 'e':
+		case 'i':
+			unread_char(in, c);
+			*datum = read_number(in);
+			return TOKEN_DATUM;
+
+		/* booleans */
+		case 't':
+		case 'T':
+			*datum = the_truth;
+			return TOKEN_DATUM;
+		case 'f':
+		case 'F':
+			*datum = the_falsity;
+			return TOKEN_DATUM;
+
+		/* characters */
+		case '\\':
+			*datum = read_character(in);
+			return TOKEN_DATUM;
+
+		/* vectors */
+		case '(':
+			return TOKEN_OPEN_VECTOR;
+
+		/* bytevectors */
+		case 'u':
+		case 'U':
+			if (port_getc(in) != '8' || port_getc(in) != '(')
+				error("Ill-formed bytevector -- read", nil);
+
+			return TOKEN_OPEN_BYTEVECTOR;
+
+		/* commented form, read and discard */
+		case ';':
+			return TOKEN_SKIP;
+
+		/* datum labels, #n= and #n# */
+		case '0' ... '9':
+			for (n = c - '0'; isdigit(c = port_getc(in)); n = 10 * n + c - '0')
+				if (n > (LONG_MAX >> 2) / 10)
+					error("Datum label too large -- read", nil);
+
+			*datum = make_fixnum(n);
+
+			if (c == '=')
+				return TOKEN_LABEL;
+			if (c == '#')
+				return TOKEN_REFERENCE;
+
+			error("Ill-formed datum label -- read", nil);
+
+		case '<':
+			error("Object cannot be read back -- read", nil);
 
-		/* ... */
-		if (peek_char(in) == '.')
-			goto proper_pair;
 
-		c = fgetc(in);
-		if (!isspace(c))
-			error("Missing delimiter in improper list -- read", nil);
+		default:
+			error("Unexpected character -- read", nil);
+		}
+	}
+	/* number */
+	else if (isdigit(c) ||
+		 ((c == '-' || c == '+') && isdigit(port_peekc(in)))) {
+		unread_char(in, c);
+		*datum = read_number(in);
+		return TOKEN_DATUM;
+	}
+	/* string */
+	else if (c == '"') {
+		*datum = read_string(in);
+		return TOKEN_DATUM;
+	}
+	/* symbol */
+	else if (char_is(c, CC_INITIAL)) {
+		unread_char(in, c);
+		*datum = read_identifier(in);
+		return TOKEN_DATUM;
+	}
+	/* peculiar identifiers */
+	else if (((c == '+') || c == '-') && is_delimiter(port_peekc(in))) {
+		*datum = make_symbol_c((c == '+' ? "+" : "-"));
+		return TOKEN_DATUM;
+	}
+	/* the dot of an improper list, or an ellipsis. FIXME for floats */
+	else if (c == '.') {
+		if (is_delimiter(port_peekc(in)))
+			return TOKEN_DOT;
 
-		the_cdr = lisp_read(in);
-		skip_atmospheric(in);
+		c = port_getc(in);
+		if (c != '.' || port_peekc(in) != '.')
+			error("Symbol has bad name -- read", nil);
 
-		c = fgetc(in);
-		if (c == ')')
-			return cons(the_car, the_cdr);
+		c = port_getc(in);
+		if (!is_delimiter(port_peekc(in)))
+			error("Symbol has bad name -- read", nil);
 
-		error("Missing parenthesis -- read", nil);
+		*datum = _ellipsis;
+		return TOKEN_DATUM;
+	}
+	/* lists */
+	else if (c == '(') {
+		return TOKEN_OPEN;
+	}
+	else if (c == ')') {
+		return TOKEN_CLOSE;
+	}
+	/* quote */
+	else if (c == '\'') {
+		*datum = _quote;
+		return TOKEN_PREFIX;
+	}
+	/* quasiquote */
+	else if (c == '`') {
+		*datum = _quasiquote;
+		return TOKEN_PREFIX;
+	}
+	/* unquote & unquote-splicing */
+	else if (c == ',') {
+		if (port_peekc(in) == '@') {
+			c = port_getc(in);
+			*datum = _unquote_splicing;
+		} else
+			*datum = _unquote;
+
+		return TOKEN_PREFIX;
 	}
 
-proper_pair:
+	error("Unexpected character -- read", nil);
+	return TOKEN_EOF;		     /* not reached */
+}
 
-	ungetc(c, in);
-	the_cdr = read_pair(in);
-	return cons(the_car, the_cdr);
+/* Whatever is still open while reading, innermost first, is kept on a
+   stack of frames in the heap, so neither long lists nor deep nesting
+   take C stack. A frame is (kind head . last) for lists, vectors and
+   bytevectors, (kind . symbol) for quote and the like, or
+   (kind . placeholder) for a labelled datum. */
+
+#define FRAME_LIST    0
+#define FRAME_DOTTED  1			     /* ... waiting for what follows the dot */
+#define FRAME_CLOSING 2			     /* ... and now for the parenthesis */
+#define FRAME_VECTOR  3
+#define FRAME_PREFIX  4
+#define FRAME_SKIP    5			     /* #; */
+#define FRAME_LABEL   6			     /* #n= */
+#define FRAME_BYTEVECTOR 7
+
+#define frame_kind(frame)   fixnum_value(car(frame))
+#define frame_symbol(frame) cdr(frame)
+#define frame_head(frame)   cadr(frame)
+#define frame_last(frame)   cddr(frame)
+#define frame_placeholder(frame) cdr(frame)
+
+/* What a reference to a label stands for until its datum is read, a
+   pair (label_marker . datum) with the marker in place of the datum. */
+static object label_marker;
+
+#define is_placeholder(o) (is_pair(o) && car(o) == label_marker)
+#define placeholder_value(o) cdr(o)
+
+static object make_read_frame(long kind, object o)
+{
+	return cons(make_fixnum(kind), o);
 }
 
-object read_vector(FILE *in)
+/* Gives a datum to the innermost frame. Returns 1 when nothing was
+   open, and the datum is what was read. */
+static int read_complete(object *stack, object *datum)
 {
-	object the_list;
+	object frame, pair;
+
+	while (!is_null(*stack)) {
+		frame = car(*stack);
+
+		switch (frame_kind(frame)) {
+		case FRAME_PREFIX:
+			*datum = list(2, frame_symbol(frame), *datum);
+			*stack = cdr(*stack);
+			continue;
+
+		case FRAME_SKIP:
+			*stack = cdr(*stack);
+			return 0;
+
+		case FRAME_LABEL:
+			if (*datum == frame_placeholder(frame))
+				error("Datum label refers to itself -- read", nil);
+
+			set_cdr(frame_placeholder(frame), *datum);
+			*stack = cdr(*stack);
+			continue;
+
+		case FRAME_BYTEVECTOR:
+			if (!is_fixnum(*datum) || fixnum_value(*datum) < 0 || fixnum_value(*datum) > 255)
+				error("Not a byte -- read", *datum);
+			/* fall through */
+		case FRAME_LIST:
+		case FRAME_VECTOR:
+			pair = cons(*datum, nil);
+
+			if (is_null(frame_head(frame)))
+				set_car(cdr(frame), pair);
+			else
+				set_cdr(frame_last(frame), pair);
 
-	if (!is_list((the_list = lisp_read(in))))
-		error("Cannot read vector -- read", the_list);
+			set_cdr(cdr(frame), pair);
+			return 0;
 
-	return list_to_vector(the_list);
+		case FRAME_DOTTED:
+			set_cdr(frame_last(frame), *datum);
+			set_car(frame, make_fixnum(FRAME_CLOSING));
+			return 0;
+
+		default:
+			error("Missing parenthesis -- read", nil);
+		}
+	}
+
+	return 1;
 }
 
-object lisp_read(FILE *in)
+/* Points whatever still refers to a placeholder at its datum instead,
+   once the whole datum is read. */
+static void patch_references(object exp)
 {
-	int c;
+	struct shared_table shared;
+	unsigned long i, j;
+	object o;
+
+	shared_table_init(&shared);
+	shared_scan(&shared, exp);
+
+	for (i = 0; i < shared.size; i++) {
+		o = shared.keys[i];
 
-	while ((c = fgetc(in)) != EOF) {
-		/* atmosphere */
-		if (isspace(c)) {
+		if (o == NULL || is_placeholder(o))
 			continue;
+
+		if (is_pair(o)) {
+			if (is_placeholder(car(o)))
+				set_car(o, placeholder_value(car(o)));
+			if (is_placeholder(cdr(o)))
+				set_cdr(o, placeholder_value(cdr(o)));
+		} else {
+			for (j = 0; j < vector_length(o); j++)
+				if (is_placeholder(vector_ref(o, j)))
+					vector_set(o, j, placeholder_value(vector_ref(o, j)));
 		}
-		else if (c == ';') {
-			while (c != EOF && c != '\n')
-				c = fgetc(in);
+	}
+
+	shared_table_free(&shared);
+}
+
+object lisp_read(struct port *in)
+{
+	object stack = nil, labels = nil, frame, datum, placeholder;
+	int forward = 0;
+
+	if (label_marker == NULL)
+		label_marker = make_string_c("datum label");
+
+	while (1) {
+		switch (read_token(in, &datum)) {
+		case TOKEN_EOF:
+			if (!is_null(stack))
+				error("Unexpected EOF -- read", nil);
+
+			return end_of_file;
+
+		case TOKEN_OPEN:
+			stack = cons(make_read_frame(FRAME_LIST, cons(nil, nil)), stack);
 			continue;
-		}
-		/* characters, booleans or numbers with radix */
-		else if (c == '#') {
-			c = fgetc(in);
-
-			switch (c) {
-			/* number prefixes */
-			case 'b':
-			case 'B':
-			case 'o':
-			case 'O':
-			case 'x':
-			case 'X':
-			case 'd':
-			case 'D':
-			case 'e':
-			case 'i':
-				ungetc(c, in);
-				return read_number(in);
-
-			/* booleans */
-			case 't':
-			case 'T':
-				return the_truth;
-			case 'f':
-			case 'F':
-				return the_falsity;
-
-			/* characters */
-			case '\\':
-				return read_character(in);
 
-			/* vectors */
-			case '(':
-				ungetc(c, in);
-				return read_vector(in);
+		case TOKEN_OPEN_VECTOR:
+			stack = cons(make_read_frame(FRAME_VECTOR, cons(nil, nil)), stack);
+			continue;
 
-			/* commented form, read and discard */
-			case ';':
-				lisp_read(in);
-				continue;
+		case TOKEN_OPEN_BYTEVECTOR:
+			stack = cons(make_read_frame(FRAME_BYTEVECTOR, cons(nil, nil)), stack);
+			continue;
 
-			case '<':
-				error("Object cannot be read back -- read", nil);
+		case TOKEN_PREFIX:
+			stack = cons(make_read_frame(FRAME_PREFIX, datum), stack);
+			continue;
 
+		case TOKEN_SKIP:
+			stack = cons(make_read_frame(FRAME_SKIP, nil), stack);
+			continue;
 
-			default:
-				error("Unexpected character -- read", nil);
-			}
-		}
-		/* number */
-		else if (isdigit(c) ||
-			 ((c == '-') && isdigit(peek_char(in))) ||
-			 ((c == '+') && isdigit(peek_char(in)))) {
-			ungetc(c, in);
-			return read_number(in);
-		}
-		/* string */
-		else if (c == '"') {
-			return read_string(in);
-		}
-		/* symbol */
-		else if (is_initial(c)) {
-			ungetc(c, in);
-			return read_identifier(in);
-		}
-		/* peculiar identifiers */
-		else if (((c == '+') || c == '-') && is_delimiter(peek_char(in))) {
-			return make_symbol_c((c == '+' ? "+" : "-"));
-		}
-		/* stuff starting with dot, FIXME for floats */
-		else if (c == '.') {
-			if (is_delimiter(peek_char(in)))
-				error("Illegal use of . -- read", nil);
+		case TOKEN_LABEL:
+			placeholder = cons(label_marker, label_marker);
+			labels = cons(cons(datum, placeholder), labels);
+			stack = cons(make_read_frame(FRAME_LABEL, placeholder), stack);
+			continue;
 
-			c = fgetc(in);
-			if (c != '.' || peek_char(in) != '.')
-				error("Symbol has bad name -- read", nil);
+		case TOKEN_REFERENCE:
+			for (frame = labels; !is_null(frame); frame = cdr(frame))
+				if (caar(frame) == datum)
+					break;
 
-			c = fgetc(in);
-			if (!is_delimiter(peek_char(in)))
-				error("Symbol has bad name -- read", nil);
+			if (is_null(frame))
+				error("Undefined datum label -- read", datum);
 
-			return _ellipsis;
-		}
-		/* pair */
-		else if (c == '(') {
-			return read_pair(in);
-		}
-		/* quote */
-		else if (c == '\'') {
-			return cons(_quote, cons(lisp_read(in), nil));
-		}
-		/* quasiquote */
-		else if (c == '`') {
-			return cons(_quasiquote, cons(lisp_read(in), nil));
-		}
-		/* unquote & unquote-splicing */
-		else if (c == ',') {
-			if (peek_char(in) == '@') {
-				c = fgetc(in);
-				return cons(_unquote_splicing, cons(lisp_read(in), nil));
+			placeholder = cdar(frame);
+			if (placeholder_value(placeholder) == label_marker) {
+				datum = placeholder;
+				forward = 1;
 			} else
-				return cons(_unquote, cons(lisp_read(in), nil));
-		}
-		else
-			error("Unexpected character -- read", nil);
-	}
+				datum = placeholder_value(placeholder);
+			break;
 
-	return end_of_file;
-}
+		case TOKEN_DOT:
+			if (is_null(stack))
+				error("Illegal use of . -- read", nil);
 
+			frame = car(stack);
+			if (frame_kind(frame) != FRAME_LIST || is_null(frame_head(frame)))
+				error("Illegal use of . -- read", nil);
 
+			set_car(frame, make_fixnum(FRAME_DOTTED));
+			continue;
 
+		case TOKEN_CLOSE:
+			if (is_null(stack))
+				error("Unexpected character -- read", nil);
 
+			frame = car(stack);
 
-static void write_pair(object pair, FILE *out)
-{
-	object car_obj, cdr_obj;
+			switch (frame_kind(frame)) {
+			case FRAME_LIST:
+			case FRAME_CLOSING:
+				datum = frame_head(frame);
+				break;
 
-	car_obj = car(pair);
-	cdr_obj = cdr(pair);
+			case FRAME_VECTOR:
+				datum = list_to_vector(frame_head(frame));
+				break;
 
-	lisp_print(car_obj, out);
+			case FRAME_BYTEVECTOR:
+				datum = list_to_bytevector(frame_head(frame));
+				break;
 
-	if (is_pair(cdr_obj)) {
-		fprintf(out, " ");
-		write_pair(cdr_obj, out);
-	}
-	else if (is_null(cdr_obj)) {
-		return;
-	}
-	else {
-		fprintf(out, " . ");
-		lisp_print(cdr_obj, out);
+			case FRAME_DOTTED:
+				error("Missing delimiter in improper list -- read", nil);
+
+			default:
+				error("Unexpected character -- read", nil);
+			}
+
+			stack = cdr(stack);
+			break;
+
+		case TOKEN_DATUM:
+			break;
+		}
+
+		if (read_complete(&stack, &datum)) {
+			if (forward)
+				patch_references(datum);
+
+			return datum;
+		}
 	}
 }
 
-void lisp_print(object exp, FILE *out)
+
+
+
+
+/* everything but pairs and vectors */
+static void write_atom(object exp, struct port *out)
 {
 	unsigned long i, len;
+	unsigned char *bytes;
 	char c;
 	char *str;
-	object *vptr;
 
 	switch (type_of(exp)) {
 	case T_NIL:
-		fprintf(out, "()");
+		port_puts(out, "()");
 		break;
 
 	case T_FIXNUM:
-		fprintf(out, "%ld", fixnum_value(exp));
+		port_put_long(out, fixnum_value(exp));
 		break;
 
 	case T_CHARACTER:
 		c = character_value(exp);
-		fprintf(out, "#\\");
+		port_puts(out, "#\\");
 		switch (c) {
 		case '\n':
-			fprintf(out, "newline");
+			port_puts(out, "newline");
 			break;
 		case ' ':
-			fprintf(out, "space");
+			port_puts(out, "space");
 			break;
 		default:
-			fprintf(out, "%c", c);
-		}
-		break;
-
-	case T_PAIR:
-		if (is_finite_list(exp, NULL)) {
-			fprintf(out, "(");
-			write_pair(exp, out);
-			fprintf(out, ")");
-		} else {
-			fprintf(out, "#<unprintable-structure>");
+			port_putc(out, c);
 		}
 		break;
 
 	case T_BOOLEAN:
-		fprintf(out, is_false(exp) ? "#f" : "#t");
+		port_puts(out, is_false(exp) ? "#f" : "#t");
 		break;
 
 	case T_STRING:
-		fprintf(out, "\"");
+		port_puts(out, "\"");
 		str = string_value(exp);
 		len = string_length(exp);
 		for (i = 0; i < len; i++) {
 			switch (str[i]) {
 			case '\n':
-				fprintf(out, "\\n");
+				port_puts(out, "\\n");
 				break;
 			case '"':
-				fprintf(out, "\\\"");
+				port_puts(out, "\\\"");
 				break;
 			case '\\':
-				fprintf(out, "\\\\");
+				port_puts(out, "\\\\");
 				break;
 			default:
-				fprintf(out, "%c", str[i]);
+				port_putc(out, str[i]);
 			}
 		}
-		fprintf(out, "\"");
+		port_puts(out, "\"");
 		break;
 
-	case T_VECTOR:
-		fprintf(out, "#(");
-		len  = vector_length(exp);
-		vptr = vector_ptr(exp);
+	case T_BYTEVECTOR:
+		port_puts(out, "#u8(");
+		bytes = bytevector_value(exp);
+		len = bytevector_length(exp);
 		for (i = 0; i < len; i++) {
-			if (i)
-				fputc(' ', out);
-
-			lisp_print(*vptr++, out);
+			if (i > 0)
+				port_putc(out, ' ');
+			port_put_long(out, bytes[i]);
 		}
-		fprintf(out, ")");
+		port_putc(out, ')');
 		break;
 
-
 	case T_SYMBOL:
-		fprintf(out, "%.*s", (int) string_length(symbol_string(exp)),
-			string_value(symbol_string(exp)));
+		port_write(out, string_value(symbol_string(exp)),
+			   string_length(symbol_string(exp)));
 		break;
 
 	case T_FOREIGN_PTR:
-		fprintf(out, "#<foreign-pointer %p>", foreign_ptr_value(exp));
+		port_printf(out, "#<foreign-pointer %p>", foreign_ptr_value(exp));
 		break;
 
 	case T_PRIMITIVE:
-		fprintf(out, "#<primitive-procedure %p>", primitive_implementation(exp));
+		port_printf(out, "#<primitive-procedure %p>", primitive_implementation(exp));
 		break;
 
 	case T_PROCEDURE:
-		fprintf(out, "#<procedure ");
+		port_puts(out, "#<procedure ");
 		lisp_print(procedure_parameters(exp), out);
-		fprintf(out, ">");
+		port_puts(out, ">");
 		break;
 
 	case T_EOF:
-		fprintf(out, "#<eof>");
+		port_puts(out, "#<eof>");
 		break;
 
 	case T_PORT:
-		fprintf(out, "#<%s-port %p>",
+		port_printf(out, "#<%s-port %p>",
 			is_input_port(exp) ? "input" : "output",
 			port_implementation(exp));
 		break;
 
 	case T_UNSPECIFIED:
 		/* actually, I could read this back... */
-		fprintf(out, "#<unspecified>");
+		port_puts(out, "#<unspecified>");
 		break;
 
 	case T_MACRO:
-		fprintf(out, "#<macro ");
+		port_puts(out, "#<macro ");
 		lisp_print(macro_parameters(exp), out);
-		fprintf(out, ">");
+		port_puts(out, ">");
+		break;
+
+	case T_SYNTAX_RULES:
+		port_puts(out, "#<syntax-rules ");
+		lisp_print(syntax_rules_literals(exp), out);
+		port_puts(out, ">");
+		break;
+
+	case T_WEAK_BOX:
+		port_puts(out, "#<weak-box ");
+		lisp_print(weak_box_value(exp), out);
+		port_puts(out, ">");
+		break;
+
+	case T_EPHEMERON:
+		port_puts(out, is_ephemeron_broken(exp) ? "#<ephemeron broken>" : "#<ephemeron>");
+		break;
+
+	case T_WEAK_TABLE:
+		port_printf(out, "#<weak-hash-table %p>", exp);
+		break;
+
+	case T_CELL:
+		port_puts(out, "#<cell ");
+		lisp_print(cell_value(exp), out);
+		port_puts(out, ">");
 		break;
 
+	case T_PAIR:
+	case T_VECTOR:
 	case T_MAX_TYPE:
 		break;
 	}
 }
 
-static void display_pair(object pair, FILE *out)
+static void display_atom(object exp, struct port *out)
 {
-	object car_obj, cdr_obj;
+	switch (type_of(exp)) {
+	case T_STRING:
+		port_write(out, string_value(exp), string_length(exp));
+		break;
+
+	case T_CHARACTER:
+		port_putc(out, character_value(exp));
+		break;
 
-	car_obj = car(pair);
-	cdr_obj = cdr(pair);
+	default:
+		write_atom(exp, out);
+		break;
+	}
+}
 
-	lisp_display(car_obj, out);
+/* What is left of the lists and vectors being printed is kept on an
+   explicit stack, so neither long lists nor deep nesting take C stack.
+   Nothing is allocated while printing, the objects need no protection.
+   With a table of shared structure, whatever is in it more than once
+   gets a label the first time it is printed, and is written as a
+   reference to it afterwards. */
+#define PRINT_STACK_MIN 64
+
+struct print_frame {
+	object o;			     /* the rest of a list, or a vector */
+	unsigned long next;		     /* ... and the index to go on from */
+};
+
+static void print_object(object exp, struct port *out, int display,
+			 struct shared_table *shared)
+{
+	struct print_frame small[PRINT_STACK_MIN], *stack = small, *top;
+	unsigned long depth = 0, size = PRINT_STACK_MIN;
+	object rest;
+	long label;
+	int fresh = 1;
 
-	if (is_pair(cdr_obj)) {
-		fprintf(out, " ");
-		display_pair(cdr_obj, out);
+	while (1) {
+		label = shared != NULL ? shared_label(shared, exp, &fresh) : -1;
+		if (label >= 0) {
+			port_putc(out, '#');
+			port_put_long(out, label);
+			port_putc(out, fresh ? '=' : '#');
+		}
+
+		/* open a list or vector, leaving the rest of it for later */
+		if ((label < 0 || fresh) &&
+		    (is_pair(exp) || (is_vector(exp) && vector_length(exp) > 0))) {
+
+			if (depth == size) {
+				if (stack == small) {
+					stack = xmalloc(2 * size * sizeof(struct print_frame));
+					memcpy(stack, small, sizeof(small));
+				} else
+					stack = xrealloc(stack, 2 * size * sizeof(struct print_frame));
+
+				size *= 2;
+			}
+
+			top = &stack[depth++];
+
+			if (is_pair(exp)) {
+				port_putc(out, '(');
+				top->o = cdr(exp);
+				top->next = 0;
+				exp = car(exp);
+			} else {
+				port_puts(out, "#(");
+				top->o = exp;
+				top->next = 1;
+				exp = vector_ref(exp, 0);
+			}
+
+			continue;
+		}
+
+		if (label >= 0)
+			;			     /* just the reference */
+		else if (is_vector(exp))
+			port_puts(out, "#()");
+		else if (display)
+			display_atom(exp, out);
+		else
+			write_atom(exp, out);
+
+		/* then whatever follows it */
+		while (depth > 0) {
+			top = &stack[depth - 1];
+
+			if (is_vector(top->o) && top->next > 0) {
+				if (top->next < vector_length(top->o)) {
+					port_putc(out, ' ');
+					exp = vector_ref(top->o, top->next++);
+					break;
+				}
+			}
+			/* a labelled tail is written after a dot */
+			else if (is_pair(top->o) &&
+				 (shared == NULL || !shared_is_shared(shared, top->o))) {
+				rest = top->o;
+				port_putc(out, ' ');
+				top->o = cdr(rest);
+				exp = car(rest);
+				break;
+			}
+			else if (!is_null(top->o)) {
+				port_puts(out, " . ");
+				exp = top->o;
+				top->o = nil;
+				break;
+			}
+
+			port_putc(out, ')');
+			depth--;
+		}
+
+		if (depth == 0)
+			break;
 	}
-	else if (is_null(cdr_obj)) {
+
+	if (stack != small)
+		xfree(stack);
+}
+
+/* Labels for everything shared with write_shared, for write and
+   display only when there are cycles, which couldn't be printed
+   otherwise. */
+static void print_shared(object exp, struct port *out, int display, int always)
+{
+	struct shared_table shared;
+
+	/* most data has no cycles, and no need for labels */
+	if ((!is_pair(exp) && !is_vector(exp)) ||
+	    (!always && !shared_maybe_cyclic(exp))) {
+		print_object(exp, out, display, NULL);
 		return;
 	}
-	else {
-		fprintf(out, " . ");
-		lisp_display(cdr_obj, out);
-	}
 
+	shared_table_init(&shared);
+	shared_scan(&shared, exp);
+
+	print_object(exp, out, display, always || shared.cycles ? &shared : NULL);
+
+	shared_table_free(&shared);
 }
 
-void lisp_display(object exp, FILE *out)
+void lisp_print(object exp, struct port *out)
 {
+	print_shared(exp, out, 0, 0);
+}
 
-	switch (type_of(exp)) {
+void lisp_display(object exp, struct port *out)
+{
+	print_shared(exp, out, 1, 0);
+}
 
-	case T_STRING:
-		fprintf(out, "%.*s", (int) string_length(exp), string_value(exp));
-		break;
+void lisp_write_shared(object exp, struct port *out)
+{
+	print_shared(exp, out, 0, 1);
+}
 
-	case T_CHARACTER:
-		fputc(character_value(exp), out);
-		break;
+static void release_port(void *port)
+{
+	port_close((struct port *) port);
+}
 
-	case T_PAIR:
-		if (is_finite_list(exp, NULL)) {
-			fprintf(out, "(");
-			display_pair(exp, out);
-			fprintf(out, ")");
-		} else {
-			fprintf(out, "#<unprintable-structure>");
-		}
-		break;
+/* out of any region, to be finalized */
+static object make_finalized_port(struct port *p, unsigned long port_type)
+{
+	unsigned long depth;
+	object port;
 
-	default:
-		lisp_print(exp, out);
-		break;
+	depth = gc_region_suspend();
+
+	port = make_port(p, port_type);
+	gc_register_finalizer(port, release_port, p);
+
+	gc_region_resume(depth);
+
+	return port;
+}
+
+/* files left open by dropped ports are only closed by their finalizers */
+static struct port *open_file(char *name, int input)
+{
+	struct port *port;
+
+	gc_run_finalizers();
+
+	if ((port = port_open_file(name, input)) == NULL && (errno == EMFILE || errno == ENFILE)) {
+		gc_collect();
+		gc_run_finalizers();
+
+		port = port_open_file(name, input);
 	}
+
+	return port;
 }
 
+/* nil if it can't be opened */
+static object file_port(char *name, unsigned long port_type)
+{
+	struct port *p;
+
+	if ((p = open_file(name, port_type == PORT_TYPE_INPUT)) == NULL)
+		return nil;
+
+	return make_finalized_port(p, port_type);
+}
 
 object io_file_as_port(object filename, unsigned long port_type)
 {
 	char *name;
 	unsigned long namelen;
-	FILE *f;
+	object port;
 
 	namelen = string_length(filename);
 
@@ -696,73 +1143,355 @@ object io_file_as_port(object filename, unsigned long port_type)
 	memcpy(name, string_value(filename), namelen);
 	name[namelen] = 0;
 
-	if ((f = fopen(name, (port_type == PORT_TYPE_INPUT) ? "r" : "w+")) == NULL) {
-		xfree(name);
+	port = file_port(name, port_type);
+	xfree(name);
+
+	if (is_null(port))
 		error("Cannot open file -- io-file-as-port", filename);
-	}
 
-	xfree(name);
+	return port;
+}
+
+object io_open_input_string(object string)
+{
+	return make_finalized_port(port_open_string(string_value(string), string_length(string)),
+				   PORT_TYPE_INPUT);
+}
 
-	return make_port(f, port_type);
+object io_open_output_string()
+{
+	return make_finalized_port(port_open_output_string(), PORT_TYPE_OUTPUT);
 }
 
 void io_close_port(object port)
 {
 	if (!is_port_closed(port)) {
-		fclose(port_implementation(port));
+		gc_cancel_finalizer(port);
+		port_close(port_implementation(port));
 		set_port_closed(port);
 	}
 }
 
+/* the implementation of a closed port is gone */
+static struct port *open_port(object port)
+{
+	if (is_port_closed(port))
+		error("Port is closed", port);
+
+	return port_implementation(port);
+}
+
+object io_get_output_string(object port)
+{
+	struct port *p = open_port(port);
+
+	if (p->kind != PORT_KIND_STRING || p->input)
+		error("Not a string output port -- get-output-string", port);
+
+	return make_string_buffer((char *) p->buffer, p->end);
+}
+
 object io_read(object port)
 {
-	return lisp_read(port_implementation(port));
+	return lisp_read(open_port(port));
+}
+
+object io_fasl_read(object port)
+{
+	return fasl_read(open_port(port));
 }
 
 object io_read_char(object port)
 {
-	int c = fgetc(port_implementation(port));
+	int c = port_getc(open_port(port));
 
 	return (c == EOF) ? end_of_file : make_character(c);
 }
 
+/* Lines and blocks are cut straight out of the port buffer, and only
+   gathered in the scratch buffer when they run past its end. */
+object io_read_line(object port)
+{
+	struct port *in = open_port(port);
+	unsigned char *p, *nl;
+	unsigned long len = 0, chunk;
+
+	if (in->start == in->end && !port_fill(in))
+		return end_of_file;
+
+	while (1) {
+		p  = in->buffer + in->start;
+		nl = memchr(p, '\n', in->end - in->start);
+
+		if (nl != NULL && len == 0) {
+			in->start = nl + 1 - in->buffer;
+			return make_string_buffer((char *) p, nl - p);
+		}
+
+		chunk = (nl != NULL ? nl : in->buffer + in->end) - p;
+		scratch_reserve(len + chunk);
+		memcpy(scratch + len, p, chunk);
+		len += chunk;
+		in->start += chunk;
+
+		if (nl != NULL) {
+			in->start++;
+			break;
+		}
+
+		if (!port_fill(in))
+			break;
+	}
+
+	return make_string_buffer(scratch, len);
+}
+
+object io_read_string(unsigned long k, object port)
+{
+	struct port *in = open_port(port);
+	unsigned char *p;
+	unsigned long len = 0, chunk;
+
+	if (k == 0)
+		return make_string(0);
+
+	if (in->start == in->end && !port_fill(in))
+		return end_of_file;
+
+	p = in->buffer + in->start;
+
+	if (k <= in->end - in->start) {
+		in->start += k;
+		return make_string_buffer((char *) p, k);
+	}
+
+	/* as much as there is, without trusting k with a string that big */
+	do {
+		chunk = MIN(k - len, in->end - in->start);
+		scratch_reserve(len + chunk);
+		memcpy(scratch + len, in->buffer + in->start, chunk);
+		len += chunk;
+		in->start += chunk;
+	} while (len < k && port_fill(in));
+
+	return make_string_buffer(scratch, len);
+}
+
+/* Read straight into the bytevector, made no bigger than what is left
+   to read. Mapped whole when that is big, its pages are only touched
+   as they are read into. A pipe can't tell, it gets a buffer's worth
+   to start with, doubled as long as it keeps filling it. */
+object io_read_bytevector(unsigned long k, object port)
+{
+	struct port *in = open_port(port);
+	unsigned long n = 0, size, available = port_available(in);
+	object bv, bigger;
+
+	if (k == 0)
+		return make_bytevector(0);
+
+	size = MIN(k, available == ULONG_MAX ? PORT_BUFFER_SIZE : available);
+	bv = make_bytevector(size);
+
+	while (1) {
+		n += port_read(in, (char *) bytevector_value(bv) + n, size - n);
+
+		if (n < size || size == k || size == available)
+			break;
+
+		bigger = make_bytevector(MIN(2 * size, k));
+		memcpy(bytevector_value(bigger), bytevector_value(bv), n);
+		bv = bigger;
+		size = bytevector_length(bv);
+	}
+
+	if (n == 0)
+		return end_of_file;
+
+	if (n == size)
+		return bv;
+
+	/* cut short by the end of the file */
+	bigger = make_bytevector(n);
+	memcpy(bytevector_value(bigger), bytevector_value(bv), n);
+
+	return bigger;
+}
+
+object io_read_bytevector_into(object bv, unsigned long start, unsigned long end, object port)
+{
+	unsigned long n;
+
+	if (start == end)
+		return make_fixnum(0);
+
+	n = port_read(open_port(port), (char *) bytevector_value(bv) + start, end - start);
+
+	return (n == 0) ? end_of_file : make_fixnum(n);
+}
+
 object io_peek_char(object port)
 {
-	int c = peek_char(port_implementation(port));
+	int c = port_peekc(open_port(port));
 
 	return (c == EOF) ? end_of_file : make_character(c);
 }
 
 void io_write(object obj, object port)
 {
-	lisp_print(obj, port_implementation(port));
-	fflush(port_implementation(port));
+	lisp_print(obj, open_port(port));
+}
+
+void io_write_shared(object obj, object port)
+{
+	lisp_write_shared(obj, open_port(port));
+}
+
+void io_fasl_write(object obj, object port)
+{
+	fasl_write(obj, open_port(port));
 }
 
 void io_display(object obj, object port)
 {
-	lisp_display(obj, port_implementation(port));
-	fflush(port_implementation(port));
+	lisp_display(obj, open_port(port));
 }
 
 void io_newline(object port)
 {
-	fputc('\n', port_implementation(port));
-	fflush(port_implementation(port));
+	port_putc(open_port(port), '\n');
 }
 
 void io_write_char(object chr, object port)
 {
-	fputc(character_value(chr), port_implementation(port));
-	fflush(port_implementation(port));
+	port_putc(open_port(port), character_value(chr));
 }
 
-object io_load(object filename, object env)
+void io_write_string(object string, unsigned long start, unsigned long end, object port)
+{
+	port_write(open_port(port), string_value(string) + start, end - start);
+}
+
+void io_write_bytevector(object bv, unsigned long start, unsigned long end, object port)
+{
+	port_write(open_port(port), (char *) bytevector_value(bv) + start, end - start);
+}
+
+void io_flush(object port)
 {
-	object in;
+	port_flush(open_port(port));
+}
+
+/* What the reader makes of a loaded file is kept next to it, in
+   FILE.fasl: a fasl record telling which file it was read from, as of
+   when, and by which version of the format, then one with the list of
+   its forms. If any of that doesn't match, the file is read again and
+   the cache written anew, if it can be. The whole file is read before
+   anything in it is evaluated. */
+
+#define LOAD_CACHE_SUFFIX ".fasl"
+
+/* a C string, null terminated like every string */
+static object string_with_suffix(object s, char *suffix)
+{
+	unsigned long len = string_length(s), slen = strlen(suffix);
+	object name = make_string(len + slen);
+
+	memcpy(string_value(name), string_value(s), len);
+	memcpy(string_value(name) + len, suffix, slen);
+
+	return name;
+}
+
+static object load_cache_key(object name)
+{
+	struct stat st;
+
+	if (stat(string_value(name), &st) < 0)
+		return nil;
+
+	return list(5, make_fixnum(FASL_VERSION), name,
+		    make_fixnum(st.st_mtim.tv_sec), make_fixnum(st.st_mtim.tv_nsec),
+		    make_fixnum(st.st_size));
+}
+
+/* The forms, or #f. A cache that is unreadable, damaged or of another
+   version is as good as none. */
+static object read_load_cache(object cache, object key)
+{
+	object in, forms = the_falsity;
+
+	if (is_null(in = file_port(string_value(cache), PORT_TYPE_INPUT)))
+		return forms;
+
+	if (is_equal(fasl_try_read(open_port(in), the_falsity), key))
+		forms = fasl_try_read(open_port(in), the_falsity);
+
+	io_close_port(in);
+
+	return is_list(forms) ? forms : the_falsity;
+}
+
+static void write_load_cache(object cache, object key, object forms)
+{
+	object temp, out;
+	char suffix[32];
+
+	/* written aside, so no one reads half of it */
+	snprintf(suffix, sizeof(suffix), ".%d", getpid());
+	temp = string_with_suffix(cache, suffix);
+
+	if (is_null(out = file_port(string_value(temp), PORT_TYPE_OUTPUT)))
+		return;
+
+	io_fasl_write(key, out);
+	io_fasl_write(forms, out);
+	io_close_port(out);
+
+	rename(string_value(temp), string_value(cache));
+}
+
+static object read_forms(object filename)
+{
+	object in, exp, forms = nil, last = nil;
 
 	in = io_file_as_port(filename, PORT_TYPE_INPUT);
-	return lisp_repl(in, nil, env);
+
+	while ((exp = io_read(in)) != end_of_file) {
+		if (is_null(forms))
+			forms = last = cons(exp, nil);
+		else {
+			set_cdr(last, cons(exp, nil));
+			last = cdr(last);
+		}
+	}
+
+	io_close_port(in);
+
+	return forms;
+}
+
+object io_load(object filename, object env)
+{
+	object key, cache, forms = the_falsity, val = unspecified;
+
+	key   = load_cache_key(string_with_suffix(filename, ""));
+	cache = string_with_suffix(filename, LOAD_CACHE_SUFFIX);
+
+	if (!is_null(key))
+		forms = read_load_cache(cache, key);
+
+	if (is_false(forms)) {
+		forms = read_forms(filename);
+
+		if (!is_null(key))
+			write_load_cache(cache, key, forms);
+	}
+
+	for (; !is_null(forms); forms = cdr(forms))
+		val = lisp_eval(lisp_expand(car(forms), env), env);
+
+	return val;
 }
 
 extern jmp_buf err_jump;
@@ -775,7 +1504,7 @@ void error(char *msg, object o)
 		exit(1);
 	}
 
-	fprintf(port_implementation(current_error_port), "; %s, ", msg);
+	port_printf(port_implementation(current_error_port), "; %s, ", msg);
 	io_write(o, current_error_port);
 	io_newline(current_error_port);
 
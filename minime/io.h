@@ -3,17 +3,30 @@
 
 /* Input */
 extern object io_read(object port);
+extern object io_fasl_read(object port);
 extern object io_read_char(object port);
 extern object io_peek_char(object port);
+extern object io_read_line(object port);
+extern object io_read_string(unsigned long k, object port);
+extern object io_read_bytevector(unsigned long k, object port);
+extern object io_read_bytevector_into(object bv, unsigned long start, unsigned long end, object port);
 
 /* Output */
 extern void   io_write(object obj, object port);
+extern void   io_write_shared(object obj, object port);
+extern void   io_fasl_write(object obj, object port);
 extern void   io_display(object obj, object port);
 extern void   io_newline(object port);
 extern void   io_write_char(object chr, object port);
+extern void   io_write_string(object string, unsigned long start, unsigned long end, object port);
+extern void   io_write_bytevector(object bv, unsigned long start, unsigned long end, object port);
+extern void   io_flush(object port);
 
 /* System interface */
 extern object io_file_as_port(object filename, unsigned long port_type);
+extern object io_open_input_string(object string);
+extern object io_open_output_string();
+extern object io_get_output_string(object port);
 extern void   io_close_port(object port);
 extern object io_load(object filename, object env);
 
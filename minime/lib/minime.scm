@@ -67,3 +67,20 @@
 
 
 
+
+
+;; string ports
+
+(define (call-with-output-string proc)
+  (let ((port (open-output-string)))
+    (proc port)
+    (get-output-string port)))
+
+;; (proc line acc) for every line, the lines cut out by read-line
+(define (port-fold-lines proc initial . port)
+  (define (iter acc port)
+    (let ((line (read-line port)))
+      (if (eof-object? line)
+	  acc
+	  (iter (proc line acc) port))))
+  (iter initial (if (null? port) (current-input-port) (car port))))
@@ -0,0 +1,173 @@
+/* memo.c -- eq-keyed tables remembering work done on source expressions
+
+   The tables don't keep their keys alive: the collector treats each
+   entry as an ephemeron, marking its guard and value only once the key
+   is marked by something else, and dropping it if it never is. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <assert.h>
+
+#include "minime.h"
+
+#define MEMO_TABLE_MIN_SIZE 256
+
+struct memo_table {
+	char *name;
+	unsigned long size;		     /* always a power of two */
+	unsigned long count;
+	object *keys;
+	object *guards;
+	object *values;
+
+	unsigned long hits, misses, collected;
+
+	struct memo_table *next;
+};
+
+static struct memo_table *memo_tables;
+
+/* keys are heap pointers, the low bits carry no information */
+static inline unsigned long memo_hash(object key)
+{
+	return ((unsigned long) key >> 3) * 2654435761UL;
+}
+
+static void memo_table_alloc(struct memo_table *table, unsigned long size)
+{
+	table->size   = size;
+	table->count  = 0;
+	table->keys   = xcalloc(size, sizeof(object));
+	table->guards = xcalloc(size, sizeof(object));
+	table->values = xcalloc(size, sizeof(object));
+}
+
+struct memo_table *memo_table_create(char *name)
+{
+	struct memo_table *table = xcalloc(1, sizeof(struct memo_table));
+
+	table->name = name;
+	memo_table_alloc(table, MEMO_TABLE_MIN_SIZE);
+
+	table->next = memo_tables;
+	memo_tables = table;
+
+	return table;
+}
+
+/* the empty slot is NULL, which no heap object can be */
+static unsigned long memo_slot(struct memo_table *table, object key)
+{
+	unsigned long mask = table->size - 1;
+	unsigned long i = memo_hash(key) & mask;
+
+	while (table->keys[i] != NULL && table->keys[i] != key)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static void memo_store(struct memo_table *table, object key, object guard, object value)
+{
+	unsigned long i = memo_slot(table, key);
+
+	if (table->keys[i] == NULL) {
+		table->keys[i] = key;
+		table->count++;
+	}
+
+	table->guards[i] = guard;
+	table->values[i] = value;
+}
+
+/* the live entries only, into a table of the given size */
+static void memo_table_rehash(struct memo_table *table, unsigned long size)
+{
+	object *keys = table->keys, *guards = table->guards, *values = table->values;
+	unsigned long i, old_size = table->size;
+
+	memo_table_alloc(table, size);
+
+	for (i = 0; i < old_size; i++)
+		if (keys[i] != NULL)
+			memo_store(table, keys[i], guards[i], values[i]);
+
+	xfree(keys);
+	xfree(guards);
+	xfree(values);
+}
+
+int memo_lookup(struct memo_table *table, object key, object guard, object *value)
+{
+	unsigned long i = memo_slot(table, key);
+
+	if (table->keys[i] == NULL || table->guards[i] != guard) {
+		table->misses++;
+		return 0;
+	}
+
+	table->hits++;
+	*value = table->values[i];
+	return 1;
+}
+
+void memo_insert(struct memo_table *table, object key, object guard, object value)
+{
+	assert(key != NULL);
+
+	/* whatever was worked out inside a region goes away with it */
+	if (gc_region_depth > 0)
+		return;
+
+	/* keep the load under one half */
+	if (2 * (table->count + 1) > table->size)
+		memo_table_rehash(table, table->size * 2);
+
+	memo_store(table, key, guard, value);
+}
+
+/* called until it marks nothing new */
+void memo_tables_mark()
+{
+	struct memo_table *table;
+	unsigned long i;
+
+	for (table = memo_tables; table != NULL; table = table->next)
+		for (i = 0; i < table->size; i++)
+			if (table->keys[i] != NULL && gc_is_live(table->keys[i])) {
+				gc_mark(table->guards[i]);
+				gc_mark(table->values[i]);
+			}
+}
+
+void memo_tables_sweep()
+{
+	struct memo_table *table;
+	unsigned long i, dead;
+
+	for (table = memo_tables; table != NULL; table = table->next) {
+		for (i = 0, dead = 0; i < table->size; i++)
+			if (table->keys[i] != NULL && !gc_is_live(table->keys[i])) {
+				table->keys[i] = NULL;
+				dead++;
+			}
+
+		if (dead == 0)
+			continue;
+
+		/* the holes would break probe sequences */
+		table->collected += dead;
+		memo_table_rehash(table, table->size);
+	}
+}
+
+void memo_table_stats()
+{
+	struct memo_table *table;
+
+	for (table = memo_tables; table != NULL; table = table->next)
+		fprintf(stderr, "Cached %s: %lu entries, %lu hits, %lu misses, %lu collected\n",
+			table->name, table->count, table->hits, table->misses, table->collected);
+}
@@ -0,0 +1,17 @@
+#ifndef __MEMO_H
+#define __MEMO_H
+
+struct memo_table;
+
+extern struct memo_table *memo_table_create(char *name);
+
+/* an entry is only found again under the guard it was inserted with */
+extern int  memo_lookup(struct memo_table *table, object key, object guard, object *value);
+extern void memo_insert(struct memo_table *table, object key, object guard, object value);
+
+/* keys are weak, entries go once their key is collected */
+extern void memo_tables_mark();
+extern void memo_tables_sweep();
+extern void memo_table_stats();
+
+#endif
@@ -57,12 +57,24 @@ static int is_tagged(object exp, object tag)
 	return 0;
 }
 
+static int is_member(object o, object lst)
+{
+	while (is_pair(lst)) {
+		if (car(lst) == o)
+			return 1;
+
+		lst = cdr(lst);
+	}
+	return 0;
+}
+
 static int is_self_evaluating(object exp)
 {
 	return  is_null(exp)      ||
 		is_boolean(exp)   ||
 		is_number(exp)    ||
 		is_string(exp)    ||
+		is_bytevector(exp) ||
 		is_vector(exp)    ||
 		is_character(exp) ||
 		is_unspecified(exp);	     /* not sure this leads to right behaviour */
@@ -471,6 +483,160 @@ static object scan_out_defines(object body)
 	return nbody_head;
 }
 
+/* Flat closures.
+
+   A closure doesn't keep the environment it was made in, only the
+   local variables its body mentions, copied into a frame of its own in
+   front of the top level. Variables something assigns to are put in
+   cells when they are bound, so the copies share them. The body is
+   looked at both as written and with the macros it uses expanded, and
+   every symbol in it counts as mentioned, outside of quoted data, which
+   may keep a little too much but never too little. A body that still
+   uses or makes a macro after expansion could do anything, so its
+   lambda copies every local variable and puts all its parameters in
+   cells.
+
+   What a lambda copies and puts in cells is worked out once for each
+   shape of environment it is evaluated in, along with its body without
+   the internal definitions. */
+
+static struct memo_table *lambda_analyses;
+
+static object expand_body(object body, object env, object bound);
+static object bind_parameters(object params, object bound);
+
+static void add_symbol(object var, object *symbols)
+{
+	if (!is_member(var, *symbols))
+		*symbols = cons(var, *symbols);
+}
+
+/* a macro, or something that makes one */
+static int is_macro_operator(object op, object env)
+{
+	object val;
+
+	if (!is_symbol(op) || !lookup_variable(op, env, &val))
+		return 0;
+
+	return is_macro(val) || is_syntax_rules(val) ||
+		is_primitive_syntax(val, lisp_primitive_pmacro) ||
+		is_primitive_syntax(val, lisp_primitive_syntax_rules);
+}
+
+/* macros, unless NULL, is set if exp has a macro operator in it */
+static void body_symbols(object exp, object env, object *symbols, object *assigned, int *macros)
+{
+	object target;
+
+	if (is_tagged(exp, _quote))
+		return;
+
+	if ((is_tagged(exp, _set) || is_tagged(exp, _define)) && is_pair(cdr(exp))) {
+		target = is_pair(cadr(exp)) ? car(cadr(exp)) : cadr(exp);
+
+		if (is_symbol(target))
+			add_symbol(target, assigned);
+	}
+
+	if (macros != NULL && is_pair(exp) && is_macro_operator(car(exp), env))
+		*macros = 1;
+
+	for (; is_pair(exp); exp = cdr(exp))
+		body_symbols(car(exp), env, symbols, assigned, macros);
+
+	if (is_symbol(exp))
+		add_symbol(exp, symbols);
+}
+
+static int is_parameter(object var, object params)
+{
+	for (; is_pair(params); params = cdr(params))
+		if (car(params) == var)
+			return 1;
+
+	return params == var;
+}
+
+/* (body cells . vars), the parameters to put in cells and the local
+   variables to copy */
+static object lambda_analysis(object exp, object env)
+{
+	object params = lambda_parameters(exp), body = lambda_body(exp);
+	object shape = environment_shape(env), analysis, binding, o;
+	object symbols = nil, assigned = nil, cells = nil, vars = nil;
+	int macros = 0;
+
+	if (memo_lookup(lambda_analyses, body, shape, &analysis))
+		return analysis;
+
+	/* macro uses are expanded again when they run, and need their operators */
+	body_symbols(body, env, &symbols, &assigned, NULL);
+	body_symbols(expand_body(body, env, bind_parameters(params, nil)),
+		     env, &symbols, &assigned, &macros);
+
+	if (macros) {
+		cells   = bind_parameters(params, nil);
+		symbols = local_variables(env);
+	} else {
+		for (o = assigned; !is_null(o); o = cdr(o))
+			if (is_parameter(car(o), params))
+				cells = cons(car(o), cells);
+	}
+
+	for (o = symbols; !is_null(o); o = cdr(o))
+		if (!is_parameter(car(o), params) && lookup_local_binding(car(o), env, &binding))
+			add_symbol(car(o), &vars);
+
+	analysis = cons(scan_out_defines(body), cons(cells, vars));
+	memo_insert(lambda_analyses, body, shape, analysis);
+
+	return analysis;
+}
+
+/* a lambda applied on the spot, as let and the like become, is gone
+   with its call, there is no need to make it flat */
+static object make_closure(object exp, object env, int flat)
+{
+	object analysis = lambda_analysis(exp, env);
+	object vars = cddr(analysis), vals = nil, tail = nil, o, binding;
+
+	if (flat && !is_toplevel_environment(env)) {
+		for (o = vars; !is_null(o); o = cdr(o)) {
+			if (!lookup_local_binding(car(o), env, &binding))
+				error("Unbound variable", car(o));
+
+			if (is_null(vals)) {
+				vals = tail = cons(binding, nil);
+			} else {
+				set_cdr(tail, cons(binding, nil));
+				tail = cdr(tail);
+			}
+		}
+
+		env = toplevel_environment(env);
+		if (!is_null(vars))
+			env = extend_environment(vars, vals, env);
+	}
+
+	return make_procedure(lambda_parameters(exp), car(analysis), env, cadr(analysis));
+}
+
+/* let and the like are rewritten once per source expression */
+static struct memo_table *derived_forms;
+
+static object derived_combination(object exp, object proc, object (*convert)(object))
+{
+	object combination;
+
+	if (!memo_lookup(derived_forms, exp, proc, &combination)) {
+		combination = convert(exp);
+		memo_insert(derived_forms, exp, proc, combination);
+	}
+
+	return combination;
+}
+
 #define is_and(proc) is_primitive_syntax(proc, lisp_primitive_and)
 #define is_or(proc) is_primitive_syntax(proc, lisp_primitive_or)
 
@@ -492,6 +658,21 @@ static object list_of_values(object exps, object env)
 		     list_of_values(rest_operands(exps), env));
 }
 
+static object list_copy(object lst)
+{
+	object head = nil, tail = nil;
+
+	for (; !is_null(lst); lst = cdr(lst))
+		if (is_null(head)) {
+			head = tail = cons(car(lst), nil);
+		} else {
+			set_cdr(tail, cons(car(lst), nil));
+			tail = cdr(tail);
+		}
+
+	return head;
+}
+
 static object list_of_apply_values(object exps, object env)
 {
 	object o;
@@ -503,7 +684,8 @@ static object list_of_apply_values(object exps, object env)
 		if (!is_list((o = lisp_eval(first_operand(exps), env))))
 			error("Last argument must be a list -- apply", o);
 
-		return o;
+		/* the arguments become a frame, which must not be the caller's list */
+		return list_copy(o);
 	}
 
 	return cons( lisp_eval(first_operand(exps), env),
@@ -566,8 +748,13 @@ static void fixup_varargs(object *names, object *values)
 #define is_delay(proc) is_primitive_syntax(proc, lisp_primitive_delay)
 
 #define is_timecall(proc) is_primitive_syntax(proc, lisp_primitive_timecall)
+#define is_with_region(proc) is_primitive_syntax(proc, lisp_primitive_with_region)
 #define is_pmacro(proc) is_primitive_syntax(proc, lisp_primitive_pmacro)
 #define is_macroexpand(proc) is_primitive_syntax(proc, lisp_primitive_macroexpand)
+#define is_syntax_rules_spec(proc) is_primitive_syntax(proc, lisp_primitive_syntax_rules)
+
+/* what an operator can be bound to that rewrites its form */
+#define is_transformer(proc) (is_macro(proc) || is_syntax_rules(proc))
 
 object maybe_unquote(object exp)
 {
@@ -577,73 +764,99 @@ object maybe_unquote(object exp)
 	return exp;
 }
 
-/* quasiquotation */
-int qq_is_constant(object exp)
+/* quasiquotation
+
+   A template is expanded once into constructor code, which is then
+   remembered for the source expression. Constant parts of the
+   template are quoted as they are, so every evaluation shares them
+   and only allocates the spine leading to the unquoted parts. */
+
+static struct memo_table *qq_expansions;
+
+static int qq_is_constant(object exp)
 {
 	return is_pair(exp) ? is_quoted(exp) : !is_symbol(exp);
 }
 
-object qq_combine_parts(object left, object right, object exp, object env)
-{
-	object leval, reval;
+#define is_qq_form(exp, tag) (is_tagged(exp, tag) && is_pair(cdr(exp)) && is_null(cddr(exp)))
 
+static object qq_combine_parts(object left, object right, object exp)
+{
 	if (qq_is_constant(left) && qq_is_constant(right)) {
-		leval = lisp_eval(left, env);
-		reval = lisp_eval(right, env);
+		left  = maybe_unquote(left);
+		right = maybe_unquote(right);
 
-		if (is_eqv(leval, car(exp)) && is_eqv(reval, cdr(exp)))
+		/* nothing changed, share the template itself */
+		if (left == car(exp) && right == cdr(exp))
 			return list(2, _quote, exp);
-		else
-			return list(2, _quote, cons(leval, reval));
+
+		return list(2, _quote, cons(left, right));
 	}
 	else if (is_null(right)) {
 		return list(2, _list, left);
 	}
-	else if (is_pair(right) && car(right) == _list) {
+	else if (is_tagged(right, _list)) {
 		return cons(_list, cons(left, cdr(right)));
 	}
 
 	return list(3, _cons, left, right);
 }
 
-object qq_expand(object exp, unsigned long nesting, object env)
+static object qq_expand(object exp, unsigned long nesting)
 {
+	object rest;
+
 	if (!is_pair(exp)) {
 		if (qq_is_constant(exp))
 			return exp;
 		else
 			return list(2, _quote, exp);
 	}
-	else if (is_tagged(exp, _unquote) && length(exp) == 2) {
+	else if (is_qq_form(exp, _unquote)) {
 		if (nesting == 0)
 			return cadr(exp);
 
-		return qq_combine_parts( cons(_quote, cons(_quote, cons(_unquote, nil))),
-					 qq_expand( cdr(exp), nesting - 1, env),
-					 exp,
-					 env);
+		return qq_combine_parts( list(2, _quote, _unquote),
+					 qq_expand( cdr(exp), nesting - 1),
+					 exp);
 	}
-	else if (is_tagged(exp, _quasiquote) && length(exp) == 2) {
+	else if (is_qq_form(exp, _quasiquote)) {
 
-		return qq_combine_parts( cons(_quote, cons(_quote, cons(_quasiquote, nil))),
-					 qq_expand( cdr(exp), nesting + 1, env),
-					 exp,
-					 env);
+		return qq_combine_parts( list(2, _quote, _quasiquote),
+					 qq_expand( cdr(exp), nesting + 1),
+					 exp);
 	}
-	else if (is_pair(car(exp)) && caar(exp) == _unquote_splicing && length(car(exp)) == 2) {
-		if (nesting == 0)
-			return list(2, _append, cadr(car(exp)));
+	else if (is_qq_form(car(exp), _unquote_splicing)) {
+		if (nesting == 0) {
+			rest = qq_expand( cdr(exp), nesting);
+
+			if (is_null(rest))
+				return list(2, _append, cadr(car(exp)));
 
-		return qq_combine_parts( qq_expand( car(exp), nesting - 1, env),
-					 qq_expand( cdr(exp), nesting, env),
-					 exp,
-					 env);
+			return list(3, _append, cadr(car(exp)), rest);
+		}
+
+		return qq_combine_parts( qq_expand( car(exp), nesting - 1),
+					 qq_expand( cdr(exp), nesting),
+					 exp);
+	}
+
+	return qq_combine_parts( qq_expand( car(exp), nesting),
+				 qq_expand( cdr(exp), nesting),
+				 exp);
+}
+
+/* (quasiquote template) => constructor code */
+static object qq_template(object exp)
+{
+	object expansion;
+
+	if (!memo_lookup(qq_expansions, exp, nil, &expansion)) {
+		expansion = qq_expand(cadr(exp), 0);
+		memo_insert(qq_expansions, exp, nil, expansion);
 	}
 
-	return qq_combine_parts( qq_expand( car(exp), nesting, env),
-				 qq_expand( cdr(exp), nesting, env),
-				 exp,
-				 env);
+	return expansion;
 }
 
 /* very dirty */
@@ -651,6 +864,9 @@ object macroexpand(object macro, object exp, object env)
 {
 	object menv;
 
+	if (is_syntax_rules(macro))
+		return syntax_rules_expand(macro, exp);
+
 	menv = extend_environment( list(1, make_symbol_c("exp")),
 				  list(1, exp),
 				  env);
@@ -659,6 +875,23 @@ object macroexpand(object macro, object exp, object env)
 	return lisp_eval( macro_body(macro), menv);
 }
 
+/* Expansions are remembered per use site, for as long as the operator
+   evaluates to the same macro object */
+static struct memo_table *macro_expansions;
+static struct memo_table *syntax_rules_transformers;
+
+static object macroexpand_cached(object macro, object exp, object env)
+{
+	object expansion;
+
+	if (!memo_lookup(macro_expansions, exp, macro, &expansion)) {
+		expansion = macroexpand(macro, exp, env);
+		memo_insert(macro_expansions, exp, macro, expansion);
+	}
+
+	return expansion;
+}
+
 void breakpoint()
 {
 }
@@ -688,7 +921,10 @@ tail_call:
 
 	/* language syntax, unless the symbols are bound to something else */
 
-	proc = lisp_eval(operator(exp), env);
+	if (is_tagged(operator(exp), _lambda) && is_lambda(proc = lisp_eval(_lambda, env)))
+		proc = make_closure(operator(exp), env, 0);
+	else
+		proc = lisp_eval(operator(exp), env);
 
 	/* quote */
 	if (is_quotation(proc)) {
@@ -696,7 +932,7 @@ tail_call:
 	}
 	/* quasiquotation */
 	else if (is_quasiquotation(proc)) {
-		exp = qq_expand(cadr(exp), 0, env);
+		exp = qq_template(exp);
 		goto tail_call;
 	}
 	/* assignment */
@@ -724,10 +960,7 @@ tail_call:
 	}
 	/* lambda */
 	else if (is_lambda(proc)) {
-
-		object body = scan_out_defines(lambda_body(exp));
-
-		return make_procedure(lambda_parameters(exp), body, env);
+		return make_closure(exp, env, 1);
 	}
 	/* and */
 	else if (is_and(proc)) {
@@ -770,17 +1003,17 @@ tail_call:
 	}
 	/* let */
 	else if (is_let(proc)) {
-		exp = let_to_combination(exp);
+		exp = derived_combination(exp, proc, let_to_combination);
 		goto tail_call;
 	}
 	/* let* */
 	else if (is_letx(proc)) {
-		exp = letx_to_combination(exp);
+		exp = derived_combination(exp, proc, letx_to_combination);
 		goto tail_call;
 	}
 	/* letrec */
 	else if (is_letrec(proc)) {
-		exp = letrec_to_combination(exp);
+		exp = derived_combination(exp, proc, letrec_to_combination);
 		goto tail_call;
 	}
 	/* begin */
@@ -804,7 +1037,7 @@ tail_call:
 	}
 	/* do */
 	else if (is_do(proc)) {
-		exp = do_to_combination(exp);
+		exp = derived_combination(exp, proc, do_to_combination);
 		goto tail_call;
 	}
 	/* cond */
@@ -885,6 +1118,12 @@ tail_call:
 
 		return list(3, val, make_fixnum(t_end - t_start), make_fixnum(h_end - h_start));
 	}
+	/* with-region, only the value is kept on the way out */
+	else if (is_with_region(proc)) {
+		gc_region_enter();
+		val = lisp_eval(sequence_to_exp(operands(exp)), env);
+		return gc_region_exit(val);
+	}
 	/* break */
 	else if (is_breakpoint(proc)) {
 		breakpoint();
@@ -907,15 +1146,23 @@ tail_call:
 		val = car(car(operands(exp)));
 
 		proc = lisp_eval(val, env);
-		if (!is_macro(proc))
+		if (!is_transformer(proc))
 			error("Not a macro -- macroexpand", car(operands(exp)));
 
 		val = macroexpand(proc, car(operands(exp)), env);
 		return val;
 	}
+	/* syntax-rules, compiled once per source expression */
+	else if (is_syntax_rules_spec(proc)) {
+		if (!memo_lookup(syntax_rules_transformers, exp, nil, &val)) {
+			val = syntax_rules_compile(exp);
+			memo_insert(syntax_rules_transformers, exp, nil, val);
+		}
+		return val;
+	}
 	/* macro */
-	else if (is_macro(proc)) {
-		exp = macroexpand(proc, exp, env);
+	else if (is_transformer(proc)) {
+		exp = macroexpand_cached(proc, exp, env);
 		goto tail_call;
 	}
 	/* application */
@@ -929,6 +1176,10 @@ tail_call:
 	return nil;
 
 apply:
+	/* release functions queued by the collector run between calls */
+	if (gc_finalizers_pending)
+		gc_run_finalizers();
+
 	if (is_primitive(proc)) {
 		return apply_primitive(proc, args);
 	}
@@ -946,6 +1197,9 @@ apply:
 					 args,
 					 procedure_environment(proc));
 
+		if (!is_null(procedure_cells(proc)))
+			box_variables(procedure_cells(proc), env);
+
 		exp = sequence_to_exp(procedure_body(proc));
 
 		/* r5rs: the first argument passed to apply
@@ -959,6 +1213,255 @@ apply:
 	return nil;
 }
 
+/* Syntax expansion ahead of evaluation.
+
+   Macro uses are replaced by their expansions, and quasiquote
+   templates by their constructor code, all the way down. An operator
+   counts as syntax only if it is not shadowed by a local binding and
+   is already bound when the expression is expanded; anything else is
+   left for lisp_eval to deal with at run time. */
+
+/* the value an operator has for the expander, or NULL if it can only
+   be known at run time */
+static object syntactic_binding(object op, object env, object bound)
+{
+	object val;
+
+	if (!is_symbol(op) || is_member(op, bound) || !lookup_variable(op, env, &val))
+		return NULL;
+
+	return val;
+}
+
+static object bind_parameters(object params, object bound)
+{
+	while (is_pair(params)) {
+		bound  = cons(car(params), bound);
+		params = cdr(params);
+	}
+
+	if (is_symbol(params))
+		bound = cons(params, bound);
+
+	return bound;
+}
+
+static object bind_binding_names(object bindings, object bound)
+{
+	for (; is_pair(bindings); bindings = cdr(bindings))
+		if (is_pair(car(bindings)))
+			bound = cons(binding_name(car(bindings)), bound);
+
+	return bound;
+}
+
+/* internal definitions are scoped over the whole body */
+static object bind_body_definitions(object body, object bound)
+{
+	for (; is_pair(body); body = cdr(body))
+		if (is_tagged(car(body), _define) && is_pair(cdr(car(body))))
+			bound = cons(definition_variable(car(body)), bound);
+
+	return bound;
+}
+
+static object reuse_cons(object pair, object the_car, object the_cdr)
+{
+	if (the_car == car(pair) && the_cdr == cdr(pair))
+		return pair;
+
+	return cons(the_car, the_cdr);
+}
+
+static object expand_syntax(object exp, object env, object bound);
+
+static object expand_each(object exps, object env, object bound)
+{
+	if (!is_pair(exps))
+		return exps;
+
+	return reuse_cons(exps,
+			  expand_syntax(car(exps), env, bound),
+			  expand_each(cdr(exps), env, bound));
+}
+
+static object expand_body(object body, object env, object bound)
+{
+	return expand_each(body, env, bind_body_definitions(body, bound));
+}
+
+/* ((name init) ...), inits expanded in the given scope */
+static object expand_bindings(object bindings, object env, object bound)
+{
+	object binding;
+
+	if (!is_pair(bindings))
+		return bindings;
+
+	binding = car(bindings);
+	if (is_pair(binding))
+		binding = reuse_cons(binding, car(binding), expand_each(cdr(binding), env, bound));
+
+	return reuse_cons(bindings, binding, expand_bindings(cdr(bindings), env, bound));
+}
+
+/* let* scopes every init over the ones before it */
+static object expand_sequential_bindings(object bindings, object env, object bound)
+{
+	object binding;
+
+	if (!is_pair(bindings))
+		return bindings;
+
+	binding = car(bindings);
+	if (is_pair(binding)) {
+		binding = reuse_cons(binding, car(binding), expand_each(cdr(binding), env, bound));
+		bound   = cons(binding_name(binding), bound);
+	}
+
+	return reuse_cons(bindings, binding,
+			  expand_sequential_bindings(cdr(bindings), env, bound));
+}
+
+/* ((var init step) ...), steps are inside the loop */
+static object expand_do_bindings(object bindings, object env, object outer, object inner)
+{
+	object binding, init;
+
+	if (!is_pair(bindings))
+		return bindings;
+
+	binding = car(bindings);
+	if (is_pair(binding) && is_pair(cdr(binding))) {
+		init    = reuse_cons(cdr(binding),
+				     expand_syntax(cadr(binding), env, outer),
+				     expand_each(cddr(binding), env, inner));
+		binding = reuse_cons(binding, car(binding), init);
+	}
+
+	return reuse_cons(bindings, binding,
+			  expand_do_bindings(cdr(bindings), env, outer, inner));
+}
+
+static object expand_case_clauses(object clauses, object env, object bound)
+{
+	object clause;
+
+	if (!is_pair(clauses))
+		return clauses;
+
+	clause = car(clauses);
+	if (is_pair(clause))
+		clause = reuse_cons(clause, car(clause), expand_each(cdr(clause), env, bound));
+
+	return reuse_cons(clauses, clause, expand_case_clauses(cdr(clauses), env, bound));
+}
+
+static object expand_clause_bodies(object clauses, object env, object bound)
+{
+	if (!is_pair(clauses))
+		return clauses;
+
+	return reuse_cons(clauses,
+			  expand_each(car(clauses), env, bound),
+			  expand_clause_bodies(cdr(clauses), env, bound));
+}
+
+static object expand_syntax(object exp, object env, object bound)
+{
+	object proc, rest, inner;
+
+	if (!is_pair(exp) || !is_list(exp))
+		return exp;
+
+	proc = syntactic_binding(operator(exp), env, bound);
+	rest = operands(exp);
+
+	if (is_transformer(proc)) {
+		return expand_syntax(macroexpand_cached(proc, exp, env), env, bound);
+	}
+	else if (is_quasiquotation(proc)) {
+		return expand_syntax(qq_template(exp), env, bound);
+	}
+	else if (is_quotation(proc) || is_pmacro(proc) || is_syntax_rules_spec(proc) ||
+		 is_macroexpand(proc) || is_breakpoint(proc) || is_null(rest)) {
+		return exp;
+	}
+	/* (lambda params body ...) */
+	else if (is_lambda(proc)) {
+		inner = bind_parameters(car(rest), bound);
+		rest  = reuse_cons(rest, car(rest), expand_body(cdr(rest), env, inner));
+	}
+	/* (define (name params ...) body ...), (define name value) */
+	else if (is_definition(proc)) {
+		if (is_pair(car(rest))) {
+			inner = bind_parameters(cdar(rest), bound);
+			rest  = reuse_cons(rest, car(rest), expand_body(cdr(rest), env, inner));
+		} else {
+			rest  = reuse_cons(rest, car(rest), expand_each(cdr(rest), env, bound));
+		}
+	}
+	/* (set! name value) */
+	else if (is_assignment(proc)) {
+		rest = reuse_cons(rest, car(rest), expand_each(cdr(rest), env, bound));
+	}
+	/* (let name bindings body ...), (let bindings body ...) */
+	else if (is_let(proc)) {
+		if (is_symbol(car(rest))) {
+			inner = bind_binding_names(cadr(rest), cons(car(rest), bound));
+			rest  = reuse_cons(rest, car(rest),
+					   reuse_cons(cdr(rest),
+						      expand_bindings(cadr(rest), env, bound),
+						      expand_body(cddr(rest), env, inner)));
+		} else {
+			inner = bind_binding_names(car(rest), bound);
+			rest  = reuse_cons(rest,
+					   expand_bindings(car(rest), env, bound),
+					   expand_body(cdr(rest), env, inner));
+		}
+	}
+	else if (is_letx(proc)) {
+		inner = bind_binding_names(car(rest), bound);
+		rest  = reuse_cons(rest,
+				   expand_sequential_bindings(car(rest), env, bound),
+				   expand_body(cdr(rest), env, inner));
+	}
+	else if (is_letrec(proc)) {
+		inner = bind_binding_names(car(rest), bound);
+		rest  = reuse_cons(rest,
+				   expand_bindings(car(rest), env, inner),
+				   expand_body(cdr(rest), env, inner));
+	}
+	/* (do ((var init step) ...) (test exp ...) command ...) */
+	else if (is_do(proc)) {
+		inner = bind_binding_names(car(rest), bound);
+		rest  = reuse_cons(rest,
+				   expand_do_bindings(car(rest), env, bound, inner),
+				   expand_each(cdr(rest), env, inner));
+	}
+	/* (case key ((datum ...) exp ...) ...) */
+	else if (is_case(proc)) {
+		rest = reuse_cons(rest,
+				  expand_syntax(car(rest), env, bound),
+				  expand_case_clauses(cdr(rest), env, bound));
+	}
+	/* (cond (test exp ...) ...) */
+	else if (is_cond(proc)) {
+		rest = expand_clause_bodies(rest, env, bound);
+	}
+	/* everything else is a combination of expressions */
+	else {
+		return expand_each(exp, env, bound);
+	}
+
+	return reuse_cons(exp, operator(exp), rest);
+}
+
+object lisp_expand(object exp, object env)
+{
+	return expand_syntax(exp, env, nil);
+}
+
 object lisp_repl(object input_port, object output_port, object env)
 {
 	object exp, val = nil;
@@ -988,6 +1491,8 @@ object lisp_repl(object input_port, object output_port, object env)
 				io_write(val, output_port);
 				io_newline(output_port);
 			}
+
+			io_flush(output_port);
 		}
 	}
 
@@ -1011,7 +1516,7 @@ object setup_initial_environment(object baseenv)
 	object initial_env;
 	int i;
 
-	initial_env = extend_environment(nil, nil, baseenv);
+	initial_env = make_toplevel_environment(baseenv);
 
 	for (i = 0; the_primitives[i].name != NULL; i++) {
 		define_variable(make_symbol_c(the_primitives[i].name),
@@ -1042,9 +1547,15 @@ void scheme_init()
 	/* uses nil */
 	symbol_table_init();
 
-	current_input_port  = make_port(stdin,  PORT_TYPE_INPUT);
-	current_output_port = make_port(stdout, PORT_TYPE_OUTPUT);
-//	current_error_port  = make_port(stderr, PORT_TYPE_OUTPUT);
+	qq_expansions             = memo_table_create("quasiquote templates");
+	macro_expansions          = memo_table_create("macro expansions");
+	syntax_rules_transformers = memo_table_create("syntax-rules transformers");
+	lambda_analyses           = memo_table_create("lambda analyses");
+	derived_forms             = memo_table_create("derived forms");
+
+	current_input_port  = make_port(port_open_fd(0, 1), PORT_TYPE_INPUT);
+	current_output_port = make_port(port_open_fd(1, 0), PORT_TYPE_OUTPUT);
+//	current_error_port  = make_port(port_open_fd(2, 0), PORT_TYPE_OUTPUT);
 	current_error_port  = current_output_port;
 
 	result_prompt = make_string_c("=> ");
@@ -1083,24 +1594,28 @@ void scheme_init()
 	/* hacks */
 	_break            = make_symbol_c("break");
 
+	syntax_init();
+
 	/* environments */
-	empty_environment       = extend_environment(nil, nil, nil);
+	empty_environment       = make_toplevel_environment(nil);
 	null_environment        = setup_initial_environment(empty_environment);
-	interaction_environment = extend_environment(nil, nil, null_environment);
+	interaction_environment = make_toplevel_environment(null_environment);
 }
 
 
 static void parse_arguments(int argc, char **argv)
 {
 	struct option long_options[] = {
-		{ "emacs",     no_argument,       NULL, 'e' },
-		{ "heap-size", required_argument, NULL, 'h' },
+		{ "emacs",      no_argument,       NULL, 'e' },
+		{ "heap-size",  required_argument, NULL, 'h' },
+		{ "gc-pause",   required_argument, NULL, 'p' },
+		{ "gc-threads", required_argument, NULL, 't' },
 
 		{ 0, 0, 0, 0 }
 	};
 	int opt;
 
-	while ((opt = getopt_long_only(argc, argv, "eh:", long_options, NULL)) != -1) {
+	while ((opt = getopt_long_only(argc, argv, "eh:p:t:", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'e':
 			emacs = 1;
@@ -1110,8 +1625,16 @@ static void parse_arguments(int argc, char **argv)
 			heap_size = ((unsigned long) atoi(optarg)) * 1024 * 1024;
 			break;
 
+		case 'p':
+			gc_pause_budget = (unsigned long) atoi(optarg);
+			break;
+
+		case 't':
+			gc_threads = (unsigned long) atoi(optarg);
+			break;
+
 		default:
-			fprintf(stderr, "Usage: minime [-emacs] [-heap-size MB]\n");
+			fprintf(stderr, "Usage: minime [-emacs] [-heap-size MB] [-gc-pause USECS] [-gc-threads N]\n");
 			exit(1);
 		}
 	}
@@ -1131,8 +1654,11 @@ int main(int argc, char **argv)
 	error_is_unsafe = 0;
 
 restart:
-	if (setjmp(err_jump))
+	if (setjmp(err_jump)) {
+		/* whatever the failed expression allocated in regions is garbage */
+		gc_region_abandon();
 		goto restart;
+	}
 
 	if (emacs)
 		emacs_set_default_directory(current_output_port);
@@ -1192,8 +1718,8 @@ static void check_sanity()
 	assert(is_boolean(the_falsity));
 
 	/* foreign pointers */
-	assert(is_foreign_ptr(make_foreign_ptr((void *) 0xDEADBEEF)));
-	assert(foreign_ptr_value(make_foreign_ptr((void *) 0xDEADBEEF)) == (void *) 0xDEADBEEF);
+	assert(is_foreign_ptr(make_foreign_ptr((void *) 0xDEADBEEF, NULL)));
+	assert(foreign_ptr_value(make_foreign_ptr((void *) 0xDEADBEEF, NULL)) == (void *) 0xDEADBEEF);
 
 	/* strings */
 	assert(string_length(make_string_c("foo", 3)) == 3);
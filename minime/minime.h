@@ -5,9 +5,10 @@ typedef void *object;
 
 typedef enum {
 	T_NIL = 0, T_BOOLEAN, T_FIXNUM, T_CHARACTER,
-	T_STRING, T_VECTOR, T_SYMBOL, T_PAIR, T_PRIMITIVE, T_PROCEDURE,
+	T_STRING, T_BYTEVECTOR, T_VECTOR, T_SYMBOL, T_PAIR, T_PRIMITIVE, T_PROCEDURE,
 	T_PORT, T_EOF, T_FOREIGN_PTR, T_UNSPECIFIED,
-	T_MACRO,
+	T_MACRO, T_SYNTAX_RULES,
+	T_WEAK_BOX, T_EPHEMERON, T_WEAK_TABLE, T_CELL,
 
 	T_MAX_TYPE
 } object_type;
@@ -48,17 +49,26 @@ extern int error_is_unsafe;
 extern void error(char *msg, object o);
 
 #include "xutil.h"
+#include "gc.h"
+#include "port.h"
 #include "runtime.h"
 #include "io.h"
 #include "symbols.h"
 #include "primitives.h"
 #include "environments.h"
 #include "emacs.h"
+#include "memo.h"
+#include "shared.h"
+#include "fasl.h"
+#include "weak.h"
+#include "syntax.h"
 
-extern object lisp_read(FILE *in);
+extern object lisp_read(struct port *in);
 extern object lisp_eval(object exp, object env);
-extern void   lisp_print(object exp, FILE *out);
-extern void   lisp_display(object exp, FILE *out);
+extern object lisp_expand(object exp, object env);
+extern void   lisp_print(object exp, struct port *out);
+extern void   lisp_display(object exp, struct port *out);
+extern void   lisp_write_shared(object exp, struct port *out);
 
 extern object lisp_repl(object input_port, object output_port, object env);
 
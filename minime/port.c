@@ -0,0 +1,366 @@
+/* port.c -- buffered input and output on file descriptors
+
+   Output to a terminal is written out line by line, anything else once
+   the buffer fills up. Before input is read from a terminal or the
+   standard input, all output is flushed, so prompts show up; the rest
+   is flushed on exit. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "minime.h"
+
+static struct port *output_ports;
+
+static void port_link(struct port *port)
+{
+	static int flush_at_exit;
+
+	if (!flush_at_exit) {
+		atexit(port_flush_all);
+		flush_at_exit = 1;
+	}
+
+	port->prev = NULL;
+	port->next = output_ports;
+	if (output_ports != NULL)
+		output_ports->prev = port;
+	output_ports = port;
+}
+
+static void port_unlink(struct port *port)
+{
+	if (port->prev != NULL)
+		port->prev->next = port->next;
+	else
+		output_ports = port->next;
+
+	if (port->next != NULL)
+		port->next->prev = port->prev;
+}
+
+struct port *port_open_fd(int fd, int input)
+{
+	struct port *port = xcalloc(1, sizeof(struct port));
+
+	port->fd     = fd;
+	port->input  = input;
+	port->policy = isatty(fd) ? PORT_BUFFER_LINE : PORT_BUFFER_FULL;
+	port->interactive = input && (fd == 0 || port->policy == PORT_BUFFER_LINE);
+	port->buffer = xmalloc(PORT_BUFFER_SIZE);
+	port->size   = PORT_BUFFER_SIZE;
+
+	if (!input)
+		port_link(port);
+
+	return port;
+}
+
+/* The pages are private and writable, since the reader downcases
+   symbols where they are. Truncating the file while it is being read
+   gets a SIGBUS. */
+static struct port *port_map_fd(int fd, unsigned long size)
+{
+	struct port *port;
+	void *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	madvise(p, size, MADV_SEQUENTIAL);
+	close(fd);
+
+	port = xcalloc(1, sizeof(struct port));
+
+	port->fd     = -1;
+	port->input  = 1;
+	port->policy = PORT_BUFFER_FULL;
+	port->kind   = PORT_KIND_MAPPED;
+	port->buffer = p;
+	port->start  = 0;
+	port->end    = size;
+	port->size   = size;
+
+	return port;
+}
+
+struct port *port_open_file(char *name, int input)
+{
+	struct port *port;
+	struct stat st;
+	int fd = input ?
+		open(name, O_RDONLY) :
+		open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0)
+		return NULL;
+
+	/* big files are read in place */
+	if (input && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size >= PORT_MAP_THRESHOLD &&
+	    (port = port_map_fd(fd, st.st_size)) != NULL)
+		return port;
+
+	return port_open_fd(fd, input);
+}
+
+/* a copy of s to read from */
+struct port *port_open_string(char *s, unsigned long n)
+{
+	struct port *port = xcalloc(1, sizeof(struct port));
+
+	port->fd     = -1;
+	port->input  = 1;
+	port->kind   = PORT_KIND_STRING;
+	port->buffer = xmalloc(MAX(n, 1));
+	port->end    = n;
+	port->size   = n;
+
+	memcpy(port->buffer, s, n);
+
+	return port;
+}
+
+/* what is written stays in the buffer, from 0 to end */
+struct port *port_open_output_string()
+{
+	struct port *port = xcalloc(1, sizeof(struct port));
+
+	port->fd     = -1;
+	port->kind   = PORT_KIND_STRING;
+	port->buffer = xmalloc(PORT_STRING_MIN_SIZE);
+	port->size   = PORT_STRING_MIN_SIZE;
+
+	return port;
+}
+
+void port_close(struct port *port)
+{
+	if (!port->input && port->kind == PORT_KIND_FD) {
+		port_flush(port);
+		port_unlink(port);
+	}
+
+	/* the standard ones stay open for C */
+	if (port->fd > 2)
+		close(port->fd);
+
+	if (port->kind == PORT_KIND_MAPPED)
+		munmap(port->buffer, port->size);
+	else
+		xfree(port->buffer);
+
+	xfree(port);
+}
+
+static long read_fd(struct port *port, void *s, unsigned long n)
+{
+	long got;
+
+	if (port->interactive)
+		port_flush_all();
+
+	do {
+		got = read(port->fd, s, n);
+	} while (got < 0 && errno == EINTR);
+
+	return got;
+}
+
+/* The last byte read is kept in front of the new ones, so it can
+   still be put back. */
+int port_fill(struct port *port)
+{
+	long n;
+
+	/* all there is, is already there */
+	if (port->kind != PORT_KIND_FD)
+		return 0;
+
+	if (port->end > 0)
+		port->buffer[0] = port->buffer[port->end - 1];
+
+	n = read_fd(port, port->buffer + 1, port->size - 1);
+
+	port->start = 1;
+	port->end   = 1 + ((n > 0) ? n : 0);
+
+	return n > 0;
+}
+
+/* up to n bytes, fewer only at the end of the file. Once the buffer
+   is empty, as much as would fill it is read straight into s. */
+unsigned long port_read(struct port *port, char *s, unsigned long n)
+{
+	unsigned long chunk, done = 0;
+	long got;
+
+	while (done < n) {
+		if (port->start == port->end && port->kind == PORT_KIND_FD &&
+		    n - done >= port->size - 1) {
+			if ((got = read_fd(port, s + done, n - done)) <= 0)
+				break;
+
+			done += got;
+
+			/* as if it had gone through the buffer */
+			port->buffer[0] = s[done - 1];
+			port->start = port->end = 1;
+			continue;
+		}
+
+		if (port->start == port->end && !port_fill(port))
+			break;
+
+		chunk = MIN(n - done, port->end - port->start);
+		memcpy(s + done, port->buffer + port->start, chunk);
+		port->start += chunk;
+		done += chunk;
+	}
+
+	return done;
+}
+
+/* At most how many bytes are left to read, or ULONG_MAX when a pipe
+   or a terminal can't tell. */
+unsigned long port_available(struct port *port)
+{
+	unsigned long buffered = port->end - port->start;
+	struct stat st;
+	off_t at;
+
+	if (port->kind != PORT_KIND_FD)
+		return buffered;
+
+	if (fstat(port->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (at = lseek(port->fd, 0, SEEK_CUR)) < 0)
+		return ULONG_MAX;
+
+	return buffered + (st.st_size > at ? st.st_size - at : 0);
+}
+
+static void write_all(int fd, const char *s, unsigned long n)
+{
+	long written;
+
+	while (n > 0) {
+		written = write(fd, s, n);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* nowhere to complain to, the output is lost */
+			return;
+		}
+
+		s += written;
+		n -= written;
+	}
+}
+
+void port_flush(struct port *port)
+{
+	if (port->kind != PORT_KIND_FD)
+		return;
+
+	write_all(port->fd, (char *) port->buffer + port->start, port->end - port->start);
+	port->start = port->end = 0;
+}
+
+/* Makes room for n more bytes after end, unless they are more than the
+   buffer of a file port holds. */
+void port_overflow(struct port *port, unsigned long n)
+{
+	if (port->kind != PORT_KIND_STRING) {
+		port_flush(port);
+		return;
+	}
+
+	if (port->end + n > port->size) {
+		port->size   = MAX(2 * port->size, port->end + n);
+		port->buffer = xrealloc(port->buffer, port->size);
+	}
+}
+
+void port_flush_all()
+{
+	struct port *port;
+
+	for (port = output_ports; port != NULL; port = port->next)
+		if (port->end > port->start)
+			port_flush(port);
+}
+
+void port_write(struct port *port, const char *s, unsigned long n)
+{
+	if (port->end + n > port->size)
+		port_overflow(port, n);
+
+	/* too big to be worth copying */
+	if (port->end + n > port->size) {
+		write_all(port->fd, s, n);
+		return;
+	}
+
+	memcpy(port->buffer + port->end, s, n);
+	port->end += n;
+
+	if (port->policy == PORT_BUFFER_LINE && memchr(s, '\n', n) != NULL)
+		port_flush(port);
+}
+
+void port_puts(struct port *port, const char *s)
+{
+	port_write(port, s, strlen(s));
+}
+
+void port_printf(struct port *port, const char *fmt, ...)
+{
+	char small[128], *s = small;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(small, sizeof(small), fmt, ap);
+	va_end(ap);
+
+	if (n >= (int) sizeof(small)) {
+		s = xmalloc(n + 1);
+
+		va_start(ap, fmt);
+		vsnprintf(s, n + 1, fmt, ap);
+		va_end(ap);
+	}
+
+	port_write(port, s, n);
+
+	if (s != small)
+		xfree(s);
+}
+
+/* the printer's commonest case, without going through vsnprintf */
+void port_put_long(struct port *port, long n)
+{
+	char digits[24], *p = digits + sizeof(digits);
+	unsigned long u = (n < 0) ? -(unsigned long) n : (unsigned long) n;
+
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+
+	if (n < 0)
+		*--p = '-';
+
+	port_write(port, p, digits + sizeof(digits) - p);
+}
@@ -0,0 +1,88 @@
+#ifndef __PORT_H
+#define __PORT_H
+
+#define PORT_BUFFER_SIZE 65536
+#define PORT_MAP_THRESHOLD (4 * PORT_BUFFER_SIZE) /* input files mapped whole */
+#define PORT_STRING_MIN_SIZE 128
+
+#define PORT_BUFFER_FULL 0		     /* written when the buffer fills up */
+#define PORT_BUFFER_LINE 1		     /* ... or a line is finished */
+
+#define PORT_KIND_FD     0
+#define PORT_KIND_MAPPED 1		     /* a whole file */
+#define PORT_KIND_STRING 2		     /* a string, or one being made */
+
+/* A file descriptor with a buffer in front of it. Input is read from
+   buffer[start] up to buffer[end], output waits from buffer[start] to
+   buffer[end] to be written out. Mapped and string ports have no
+   descriptor: their buffer is all the input there is, or grows to
+   hold all the output. */
+struct port {
+	int fd;
+	int input;
+	int policy;
+	int kind;
+	int interactive;		     /* output is flushed before reading it */
+
+	unsigned char *buffer;
+	unsigned long start, end, size;
+
+	struct port *next, *prev;	     /* the open output ports */
+};
+
+extern struct port *port_open_fd(int fd, int input);
+extern struct port *port_open_file(char *name, int input);
+extern struct port *port_open_string(char *s, unsigned long n);
+extern struct port *port_open_output_string();
+extern void port_close(struct port *port);
+
+/* Input */
+extern int  port_fill(struct port *port);
+extern unsigned long port_read(struct port *port, char *s, unsigned long n);
+extern unsigned long port_available(struct port *port);
+
+static inline int port_peekc(struct port *port)
+{
+	if (port->start == port->end && !port_fill(port))
+		return EOF;
+
+	return port->buffer[port->start];
+}
+
+static inline int port_getc(struct port *port)
+{
+	if (port->start == port->end && !port_fill(port))
+		return EOF;
+
+	return port->buffer[port->start++];
+}
+
+/* the last character port_getc returned, unless it was EOF */
+static inline void port_ungetc(struct port *port)
+{
+	port->start--;
+}
+
+/* Output */
+extern void port_overflow(struct port *port, unsigned long n);
+extern void port_flush(struct port *port);
+extern void port_flush_all();
+
+extern void port_write(struct port *port, const char *s, unsigned long n);
+extern void port_puts(struct port *port, const char *s);
+extern void port_put_long(struct port *port, long n);
+extern void port_printf(struct port *port, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static inline void port_putc(struct port *port, int c)
+{
+	if (port->end == port->size)
+		port_overflow(port, 1);
+
+	port->buffer[port->end++] = c;
+
+	if (c == '\n' && port->policy == PORT_BUFFER_LINE)
+		port_flush(port);
+}
+
+#endif
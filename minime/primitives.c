@@ -83,6 +83,10 @@ int is_equal(object o1, object o2)
 	if (is_string(o1) && is_string(o2))
 		return is_string_equal(o1, o2);
 
+	if (is_bytevector(o1) && is_bytevector(o2))
+		return bytevector_length(o1) == bytevector_length(o2) &&
+			memcmp(bytevector_value(o1), bytevector_value(o2), bytevector_length(o1)) == 0;
+
 	if (is_pair(o1) && is_pair(o2))
 		return  is_equal(car(o1), car(o2)) &&
 			is_equal(cdr(o1), cdr(o2));
@@ -132,11 +136,14 @@ basic_syntax_fun("delay",  lisp_primitive_delay)
 
 basic_syntax_fun("quasiquote", lisp_primitive_quasiquote)
 basic_syntax_fun("time-call",  lisp_primitive_timecall)
+basic_syntax_fun("with-region", lisp_primitive_with_region)
 
 basic_syntax_fun("break",       lisp_primitive_break)
 basic_syntax_fun("pmacro",      lisp_primitive_pmacro)
 basic_syntax_fun("macroexpand", lisp_primitive_macroexpand)
 
+basic_syntax_fun("syntax-rules", lisp_primitive_syntax_rules)
+
 
 /* Numerical operations */
 
@@ -1188,17 +1195,16 @@ object impl_make_vector(object args)
 
 object impl_vector(object args)
 {
-	long nargs = length(args);
-	object vec, *vptr;
+	long nargs = length(args), k = 0;
+	object vec;
 
 	if (nargs < 1)
 		error("Expecting at least 1 argument -- vector", args);
 
 	vec = make_vector(nargs, nil);
-	vptr = vector_ptr(vec);
 
 	while (!is_null(args)) {
-		*vptr++ = car(args);
+		vector_set(vec, k++, car(args));
 		args = cdr(args);
 	}
 
@@ -1232,7 +1238,7 @@ object impl_vector_ref(object args)
 	if (idx < 0 || idx >= vector_length(vec))
 		error("Expecting a valid vector index -- vector-ref", k);
 
-	return *(vector_ptr_ref(vec, idx));
+	return vector_ref(vec, idx);
 }
 
 object impl_vector_set(object args)
@@ -1252,7 +1258,7 @@ object impl_vector_set(object args)
 	if (idx < 0 || idx >= vector_length(vec))
 		error("Expecting a valid vector index -- vector-set!", k);
 
-	*(vector_ptr_ref(vec, idx)) = caddr(args);
+	vector_set(vec, idx, caddr(args));
 	return unspecified;
 }
 
@@ -1261,21 +1267,19 @@ object impl_vector_list(object args)
 	object head = nil, tail = nil;
 	unsigned long i, len;
 	object vec;
-	object *vptr;
 
 	check_args(1, args, "vector->list");
 
 	if (!is_vector((vec = car(args))))
 		error("Expecting a vector -- vector->list", vec);
 
-	len  = vector_length(vec);
-	vptr = vector_ptr(vec);
+	len = vector_length(vec);
 
 	for (i = 0; i < len; i++) {
 		if (is_null(head)) {
-			head = tail = cons(*vptr++, nil);
+			head = tail = cons(vector_ref(vec, i), nil);
 		} else {
-			set_cdr(tail, cons(*vptr++, nil));
+			set_cdr(tail, cons(vector_ref(vec, i), nil));
 			tail = cdr(tail);
 		}
 	}
@@ -1308,6 +1312,306 @@ object impl_vector_fill(object args)
 	return unspecified;
 }
 
+object impl_bytevectorp(object args)
+{
+	check_args(1, args, "bytevector?");
+	return boolean(is_bytevector(car(args)));
+}
+
+static inline int is_byte(object o)
+{
+	return is_fixnum(o) && fixnum_value(o) >= 0 && fixnum_value(o) <= 255;
+}
+
+object impl_make_bytevector(object args)
+{
+	unsigned long nargs = length(args);
+	object bv;
+
+	if (nargs < 1 || nargs > 2)
+		error("Expecting 1 or 2 arguments -- make-bytevector", args);
+
+	if (!is_fixnum(car(args)) || fixnum_value(car(args)) < 0)
+		error("Expecting a non-negative integer -- make-bytevector", car(args));
+
+	if (nargs == 2 && !is_byte(cadr(args)))
+		error("Expecting a byte -- make-bytevector", cadr(args));
+
+	bv = make_bytevector(fixnum_value(car(args)));
+	memset(bytevector_value(bv), (nargs == 2) ? fixnum_value(cadr(args)) : 0,
+	       bytevector_length(bv));
+
+	return bv;
+}
+
+object impl_bytevector(object args)
+{
+	object lst;
+
+	for (lst = args; !is_null(lst); lst = cdr(lst))
+		if (!is_byte(car(lst)))
+			error("Expecting bytes -- bytevector", car(lst));
+
+	return list_to_bytevector(args);
+}
+
+object impl_bytevector_length(object args)
+{
+	check_args(1, args, "bytevector-length");
+
+	if (!is_bytevector(car(args)))
+		error("Expecting a bytevector -- bytevector-length", car(args));
+
+	return make_fixnum(bytevector_length(car(args)));
+}
+
+/* The index of size bytes in bv, starting at k. */
+static long bytevector_index(object bv, object k, long size, char *name)
+{
+	char errbuf[64];
+
+	if (!is_bytevector(bv)) {
+		snprintf(errbuf, 64, "Expecting a bytevector -- %s", name);
+		error(errbuf, bv);
+	}
+
+	if (!is_fixnum(k) || fixnum_value(k) < 0 ||
+	    fixnum_value(k) + size > bytevector_length(bv)) {
+		snprintf(errbuf, 64, "Not a valid index -- %s", name);
+		error(errbuf, k);
+	}
+
+	return fixnum_value(k);
+}
+
+/* The optional start and end in args, or all of bv. */
+static void bytevector_range(object bv, object args, long *start, long *end, char *name)
+{
+	char errbuf[64];
+
+	*start = 0;
+	*end   = bytevector_length(bv);
+
+	if (!is_null(args)) {
+		if (!is_fixnum(car(args)) || fixnum_value(car(args)) < 0 ||
+		    fixnum_value(car(args)) > *end) {
+			snprintf(errbuf, 64, "Not a valid start index -- %s", name);
+			error(errbuf, car(args));
+		}
+
+		*start = fixnum_value(car(args));
+		args = cdr(args);
+	}
+
+	if (!is_null(args)) {
+		if (!is_fixnum(car(args)) || fixnum_value(car(args)) < *start ||
+		    fixnum_value(car(args)) > *end) {
+			snprintf(errbuf, 64, "Not a valid end index -- %s", name);
+			error(errbuf, car(args));
+		}
+
+		*end = fixnum_value(car(args));
+	}
+}
+
+object impl_bytevector_u8_ref(object args)
+{
+	object bv;
+	long k;
+
+	check_args(2, args, "bytevector-u8-ref");
+
+	bv = car(args);
+	k = bytevector_index(bv, cadr(args), 1, "bytevector-u8-ref");
+
+	return make_fixnum(bytevector_value(bv)[k]);
+}
+
+object impl_bytevector_u8_set(object args)
+{
+	object bv;
+	long k;
+
+	check_args(3, args, "bytevector-u8-set!");
+
+	bv = car(args);
+	k = bytevector_index(bv, cadr(args), 1, "bytevector-u8-set!");
+
+	if (!is_byte(caddr(args)))
+		error("Expecting a byte -- bytevector-u8-set!", caddr(args));
+
+	bytevector_value(bv)[k] = fixnum_value(caddr(args));
+	return unspecified;
+}
+
+object impl_bytevector_copy(object args)
+{
+	object bv, copy;
+	long start, end, nargs;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 3)
+		error("Expecting at least 1, at most 3 arguments -- bytevector-copy", args);
+
+	if (!is_bytevector((bv = car(args))))
+		error("Expecting a bytevector -- bytevector-copy", bv);
+
+	bytevector_range(bv, cdr(args), &start, &end, "bytevector-copy");
+
+	copy = make_bytevector(end - start);
+	memcpy(bytevector_value(copy), bytevector_value(bv) + start, end - start);
+
+	return copy;
+}
+
+object impl_bytevector_copy_x(object args)
+{
+	object to, from;
+	long at, start, end, nargs;
+
+	nargs = length(args);
+	if (nargs < 3 || nargs > 5)
+		error("Expecting at least 3, at most 5 arguments -- bytevector-copy!", args);
+
+	to = car(args);
+	if (!is_bytevector((from = caddr(args))))
+		error("Expecting a bytevector -- bytevector-copy!", from);
+
+	bytevector_range(from, cdddr(args), &start, &end, "bytevector-copy!");
+	at = bytevector_index(to, cadr(args), end - start, "bytevector-copy!");
+
+	/* the two may overlap */
+	memmove(bytevector_value(to) + at, bytevector_value(from) + start, end - start);
+
+	return unspecified;
+}
+
+object impl_bytevector_append(object args)
+{
+	unsigned long len = 0;
+	unsigned char *p;
+	object lst, bv;
+
+	for (lst = args; !is_null(lst); lst = cdr(lst)) {
+		if (!is_bytevector(car(lst)))
+			error("Expecting bytevectors -- bytevector-append", car(lst));
+
+		len += bytevector_length(car(lst));
+	}
+
+	bv = make_bytevector(len);
+	p  = bytevector_value(bv);
+
+	for (lst = args; !is_null(lst); lst = cdr(lst)) {
+		memcpy(p, bytevector_value(car(lst)), bytevector_length(car(lst)));
+		p += bytevector_length(car(lst));
+	}
+
+	return bv;
+}
+
+/* Integers of 2, 4 or 8 bytes, in either byte order, the endianness
+   given as big or little. Put together a byte at a time, which the
+   compiler makes a load and a byte swap of when it can. */
+static int is_little_endian(object endianness, char *name)
+{
+	static object big, little;
+	char errbuf[64];
+
+	if (big == NULL) {
+		big    = make_symbol_c("big");
+		little = make_symbol_c("little");
+	}
+
+	if (endianness != big && endianness != little) {
+		snprintf(errbuf, 64, "Expecting big or little -- %s", name);
+		error(errbuf, endianness);
+	}
+
+	return endianness == little;
+}
+
+static object bytevector_int_ref(object args, long size, int is_signed, char *name)
+{
+	unsigned char *p;
+	unsigned long u = 0;
+	long i, k, n, shift = 8 * (sizeof(long) - size);
+	int little;
+	char errbuf[64];
+
+	check_args(3, args, name);
+
+	k = bytevector_index(car(args), cadr(args), size, name);
+	p = bytevector_value(car(args)) + k;
+	little = is_little_endian(caddr(args), name);
+
+	for (i = 0; i < size; i++)
+		u |= (unsigned long) p[little ? i : size - 1 - i] << (8 * i);
+
+	n = is_signed ? (long) (u << shift) >> shift : (long) u;
+
+	if ((!is_signed && u > LONG_MAX >> FIXNUM_SHIFT) ||
+	    n > LONG_MAX >> FIXNUM_SHIFT || n < LONG_MIN >> FIXNUM_SHIFT) {
+		snprintf(errbuf, 64, "Value does not fit in a fixnum -- %s", name);
+		error(errbuf, cadr(args));
+	}
+
+	return make_fixnum(n);
+}
+
+static object bytevector_int_set(object args, long size, int is_signed, char *name)
+{
+	unsigned char *p;
+	unsigned long u;
+	long i, k, n, bits = 8 * size;
+	int little;
+	char errbuf[64];
+
+	check_args(4, args, name);
+
+	k = bytevector_index(car(args), cadr(args), size, name);
+	p = bytevector_value(car(args)) + k;
+
+	if (!is_fixnum(caddr(args))) {
+		snprintf(errbuf, 64, "Expecting an integer -- %s", name);
+		error(errbuf, caddr(args));
+	}
+
+	n = fixnum_value(caddr(args));
+	if ((is_signed  && bits < 64 && (n < -(1L << (bits - 1)) || n >= 1L << (bits - 1))) ||
+	    (!is_signed && (n < 0 || (bits < 64 && n >= 1L << bits)))) {
+		snprintf(errbuf, 64, "Value out of range -- %s", name);
+		error(errbuf, caddr(args));
+	}
+
+	little = is_little_endian(cadddr(args), name);
+
+	for (u = n, i = 0; i < size; i++, u >>= 8)
+		p[little ? i : size - 1 - i] = u & 0xFF;
+
+	return unspecified;
+}
+
+#define bytevector_int_fun(TYPE, SIZE, SIGNED)                          \
+object impl_bytevector_##TYPE##_ref(object args)                        \
+{                                                                       \
+	return bytevector_int_ref(args, SIZE, SIGNED,                   \
+				  "bytevector-" #TYPE "-ref");          \
+}                                                                       \
+                                                                        \
+object impl_bytevector_##TYPE##_set(object args)                        \
+{                                                                       \
+	return bytevector_int_set(args, SIZE, SIGNED,                   \
+				  "bytevector-" #TYPE "-set!");         \
+}
+
+bytevector_int_fun(u16, 2, 0)
+bytevector_int_fun(s16, 2, 1)
+bytevector_int_fun(u32, 4, 0)
+bytevector_int_fun(s32, 4, 1)
+bytevector_int_fun(u64, 8, 0)
+bytevector_int_fun(s64, 8, 1)
+
 object impl_symbolp(object args)
 {
 	check_args(1, args, "symbol?");
@@ -1391,7 +1695,7 @@ object impl_null_environment(object args)
 
 	/* give back an "extended" null environment so the user can't muck
 	   with the actual null environment */
-	return extend_environment(nil, nil, null_environment);
+	return make_toplevel_environment(null_environment);
 }
 
 object impl_interaction_environment(object args)
@@ -1449,6 +1753,31 @@ object impl_open_output_file(object args)
 	return io_file_as_port(car(args), PORT_TYPE_OUTPUT);
 }
 
+object impl_open_input_string(object args)
+{
+	check_args(1, args, "open-input-string");
+	if (!is_string(car(args)))
+		error("Expecting a string -- open-input-string", car(args));
+
+	return io_open_input_string(car(args));
+}
+
+object impl_open_output_string(object args)
+{
+	check_args(0, args, "open-output-string");
+
+	return io_open_output_string();
+}
+
+object impl_get_output_string(object args)
+{
+	check_args(1, args, "get-output-string");
+	if (!is_output_port(car(args)))
+		error("Expecting an output port -- get-output-string", car(args));
+
+	return io_get_output_string(car(args));
+}
+
 object impl_close_input_port(object args)
 {
 	object port;
@@ -1495,6 +1824,24 @@ object impl_read(object args)
 	return io_read(port);
 }
 
+object impl_fasl_read(object args)
+{
+	object port = current_input_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs > 1)
+		error("Expecting at most 1 argument -- fasl-read", args);
+
+	if (nargs == 1)
+		port = car(args);
+
+	if (!is_input_port(port))
+		error("Expecting an input port -- fasl-read", port);
+
+	return io_fasl_read(port);
+}
+
 object impl_read_char(object args)
 {
 	object port = current_input_port;
@@ -1513,6 +1860,89 @@ object impl_read_char(object args)
 	return io_read_char(port);
 }
 
+object impl_read_line(object args)
+{
+	object port = current_input_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs > 1)
+		error("Expecting at most 1 argument -- read-line", args);
+
+	if (nargs == 1)
+		port = car(args);
+
+	if (!is_input_port(port))
+		error("Expecting an input port -- read-line", port);
+
+	return io_read_line(port);
+}
+
+object impl_read_string(object args)
+{
+	object port = current_input_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 2)
+		error("Expecting at least 1, at most 2 arguments -- read-string", args);
+
+	if (!is_fixnum(car(args)) || fixnum_value(car(args)) < 0)
+		error("Expecting a non-negative integer -- read-string", car(args));
+
+	if (nargs == 2)
+		port = cadr(args);
+
+	if (!is_input_port(port))
+		error("Expecting an input port -- read-string", port);
+
+	return io_read_string(fixnum_value(car(args)), port);
+}
+
+object impl_read_bytevector(object args)
+{
+	object port = current_input_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 2)
+		error("Expecting at least 1, at most 2 arguments -- read-bytevector", args);
+
+	if (!is_fixnum(car(args)) || fixnum_value(car(args)) < 0)
+		error("Expecting a non-negative integer -- read-bytevector", car(args));
+
+	if (nargs == 2)
+		port = cadr(args);
+
+	if (!is_input_port(port))
+		error("Expecting an input port -- read-bytevector", port);
+
+	return io_read_bytevector(fixnum_value(car(args)), port);
+}
+
+object impl_read_bytevector_x(object args)
+{
+	object bv, port = current_input_port;
+	long nargs, start, end;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 4)
+		error("Expecting at least 1, at most 4 arguments -- read-bytevector!", args);
+
+	if (!is_bytevector((bv = car(args))))
+		error("Expecting a bytevector -- read-bytevector!", bv);
+
+	if (nargs > 1)
+		port = cadr(args);
+
+	if (!is_input_port(port))
+		error("Expecting an input port -- read-bytevector!", port);
+
+	bytevector_range(bv, nargs > 1 ? cddr(args) : nil, &start, &end, "read-bytevector!");
+
+	return io_read_bytevector_into(bv, start, end, port);
+}
+
 object impl_peek_char(object args)
 {
 	object port = current_input_port;
@@ -1551,6 +1981,46 @@ object impl_write(object args)
 	return unspecified;
 }
 
+object impl_write_shared(object args)
+{
+	object port = current_output_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 2)
+		error("Expecting at least 1, at most 2 arguments -- write-shared", args);
+
+	if (nargs == 2)
+		port = cadr(args);
+
+	if (!is_output_port(port))
+		error("Expecting an output port -- write-shared", port);
+
+	io_write_shared(car(args), port);
+
+	return unspecified;
+}
+
+object impl_fasl_write(object args)
+{
+	object port = current_output_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 2)
+		error("Expecting at least 1, at most 2 arguments -- fasl-write", args);
+
+	if (nargs == 2)
+		port = cadr(args);
+
+	if (!is_output_port(port))
+		error("Expecting an output port -- fasl-write", port);
+
+	io_fasl_write(car(args), port);
+
+	return unspecified;
+}
+
 object impl_display(object args)
 {
 	object port = current_output_port;
@@ -1591,6 +2061,98 @@ object impl_newline(object args)
 	return unspecified;
 }
 
+object impl_flush_output_port(object args)
+{
+	object port = current_output_port;
+	long nargs;
+
+	nargs = length(args);
+	if (nargs > 1)
+		error("Expecting at most 1 argument -- flush-output-port", args);
+
+	if (nargs == 1)
+		port = car(args);
+
+	if (!is_output_port(port))
+		error("Expecting an output port -- flush-output-port", port);
+
+	io_flush(port);
+
+	return unspecified;
+}
+
+/* (write-string string [port [start [end]]]) */
+object impl_write_string(object args)
+{
+	object string, port = current_output_port;
+	long nargs, start = 0, end;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 4)
+		error("Expecting at least 1, at most 4 arguments -- write-string", args);
+
+	string = car(args);
+	if (!is_string(string))
+		error("Expecting a string -- write-string", string);
+
+	end = string_length(string);
+
+	if (nargs > 1)
+		port = cadr(args);
+
+	if (!is_output_port(port))
+		error("Expecting an output port -- write-string", port);
+
+	if (nargs > 2) {
+		if (!is_fixnum(caddr(args)))
+			error("Expecting an integer start index -- write-string", caddr(args));
+
+		start = fixnum_value(caddr(args));
+	}
+
+	if (nargs > 3) {
+		if (!is_fixnum(cadddr(args)))
+			error("Expecting an integer end index -- write-string", cadddr(args));
+
+		end = fixnum_value(cadddr(args));
+	}
+
+	if (start < 0 || start > string_length(string))
+		error("Not a valid start index -- write-string", make_fixnum(start));
+
+	if (end < start || end > string_length(string))
+		error("Not a valid end index -- write-string", make_fixnum(end));
+
+	io_write_string(string, start, end, port);
+
+	return unspecified;
+}
+
+object impl_write_bytevector(object args)
+{
+	object bv, port = current_output_port;
+	long nargs, start, end;
+
+	nargs = length(args);
+	if (nargs < 1 || nargs > 4)
+		error("Expecting at least 1, at most 4 arguments -- write-bytevector", args);
+
+	if (!is_bytevector((bv = car(args))))
+		error("Expecting a bytevector -- write-bytevector", bv);
+
+	if (nargs > 1)
+		port = cadr(args);
+
+	if (!is_output_port(port))
+		error("Expecting an output port -- write-bytevector", port);
+
+	bytevector_range(bv, nargs > 1 ? cddr(args) : nil, &start, &end, "write-bytevector");
+
+	io_write_bytevector(bv, start, end, port);
+
+	return unspecified;
+}
+
 object impl_write_char(object args)
 {
 	object port = current_output_port;
@@ -1631,6 +2193,153 @@ object impl_gensym(object args)
 	return gensym();
 }
 
+object impl_gc(object args)
+{
+	check_args(0, args, "gc");
+	gc_collect();
+	return unspecified;
+}
+
+/* Weak references */
+
+object impl_make_weak_box(object args)
+{
+	check_args(1, args, "make-weak-box");
+	return make_weak_box(car(args));
+}
+
+object impl_weak_boxp(object args)
+{
+	check_args(1, args, "weak-box?");
+	return boolean(is_weak_box(car(args)));
+}
+
+object impl_weak_box_value(object args)
+{
+	check_args(1, args, "weak-box-value");
+
+	if (!is_weak_box(car(args)))
+		error("Expecting a weak box -- weak-box-value", car(args));
+
+	return weak_box_value(car(args));
+}
+
+object impl_weak_box_set(object args)
+{
+	check_args(2, args, "weak-box-set!");
+
+	if (!is_weak_box(car(args)))
+		error("Expecting a weak box -- weak-box-set!", car(args));
+
+	set_weak_box_value(car(args), cadr(args));
+	return unspecified;
+}
+
+object impl_make_ephemeron(object args)
+{
+	check_args(2, args, "make-ephemeron");
+	return make_ephemeron(car(args), cadr(args));
+}
+
+object impl_ephemeronp(object args)
+{
+	check_args(1, args, "ephemeron?");
+	return boolean(is_ephemeron(car(args)));
+}
+
+object impl_ephemeron_key(object args)
+{
+	check_args(1, args, "ephemeron-key");
+
+	if (!is_ephemeron(car(args)))
+		error("Expecting an ephemeron -- ephemeron-key", car(args));
+
+	return ephemeron_key(car(args));
+}
+
+object impl_ephemeron_value(object args)
+{
+	check_args(1, args, "ephemeron-value");
+
+	if (!is_ephemeron(car(args)))
+		error("Expecting an ephemeron -- ephemeron-value", car(args));
+
+	return ephemeron_value(car(args));
+}
+
+object impl_ephemeron_brokenp(object args)
+{
+	check_args(1, args, "ephemeron-broken?");
+
+	if (!is_ephemeron(car(args)))
+		error("Expecting an ephemeron -- ephemeron-broken?", car(args));
+
+	return boolean(is_ephemeron_broken(car(args)));
+}
+
+object impl_make_weak_hash_table(object args)
+{
+	check_args(0, args, "make-weak-hash-table");
+	return make_weak_table(WEAK_TABLE_MIN_SIZE);
+}
+
+object impl_weak_hash_tablep(object args)
+{
+	check_args(1, args, "weak-hash-table?");
+	return boolean(is_weak_table(car(args)));
+}
+
+/* (weak-hash-table-ref table key [default]) */
+object impl_weak_hash_table_ref(object args)
+{
+	long nargs = length(args);
+	object value;
+
+	if (nargs < 2 || nargs > 3)
+		error("Expecting 2 or 3 arguments -- weak-hash-table-ref", args);
+
+	if (!is_weak_table(car(args)))
+		error("Expecting a weak hash table -- weak-hash-table-ref", car(args));
+
+	if (weak_table_lookup(car(args), cadr(args), &value))
+		return value;
+
+	return nargs == 3 ? caddr(args) : the_falsity;
+}
+
+object impl_weak_hash_table_set(object args)
+{
+	check_args(3, args, "weak-hash-table-set!");
+
+	if (!is_weak_table(car(args)))
+		error("Expecting a weak hash table -- weak-hash-table-set!", car(args));
+
+	weak_table_insert(car(args), cadr(args), caddr(args));
+	return unspecified;
+}
+
+object impl_weak_hash_table_delete(object args)
+{
+	check_args(2, args, "weak-hash-table-delete!");
+
+	if (!is_weak_table(car(args)))
+		error("Expecting a weak hash table -- weak-hash-table-delete!", car(args));
+
+	weak_table_delete(car(args), cadr(args));
+	return unspecified;
+}
+
+object impl_weak_hash_table_count(object args)
+{
+	check_args(1, args, "weak-hash-table-count");
+
+	if (!is_weak_table(car(args)))
+		error("Expecting a weak hash table -- weak-hash-table-count", car(args));
+
+	return make_fixnum(weak_table_entries(car(args)));
+}
+
+
 object impl_error(object args)
 {
 	long nargs = length(args);
@@ -1857,6 +2566,32 @@ struct primitive the_primitives[] = {
 	{ "list->vector",  impl_list_vector               },
 	{ "vector-fill!",  impl_vector_fill               },
 
+
+	/* Bytevectors */
+
+	{ "bytevector?",         impl_bytevectorp         },
+	{ "make-bytevector",     impl_make_bytevector     },
+	{ "bytevector",          impl_bytevector          },
+	{ "bytevector-length",   impl_bytevector_length   },
+	{ "bytevector-u8-ref",   impl_bytevector_u8_ref   },
+	{ "bytevector-u8-set!",  impl_bytevector_u8_set   },
+	{ "bytevector-copy",     impl_bytevector_copy     },
+	{ "bytevector-copy!",    impl_bytevector_copy_x   },
+	{ "bytevector-append",   impl_bytevector_append   },
+
+	{ "bytevector-u16-ref",  impl_bytevector_u16_ref  },
+	{ "bytevector-u16-set!", impl_bytevector_u16_set  },
+	{ "bytevector-s16-ref",  impl_bytevector_s16_ref  },
+	{ "bytevector-s16-set!", impl_bytevector_s16_set  },
+	{ "bytevector-u32-ref",  impl_bytevector_u32_ref  },
+	{ "bytevector-u32-set!", impl_bytevector_u32_set  },
+	{ "bytevector-s32-ref",  impl_bytevector_s32_ref  },
+	{ "bytevector-s32-set!", impl_bytevector_s32_set  },
+	{ "bytevector-u64-ref",  impl_bytevector_u64_ref  },
+	{ "bytevector-u64-set!", impl_bytevector_u64_set  },
+	{ "bytevector-s64-ref",  impl_bytevector_s64_ref  },
+	{ "bytevector-s64-set!", impl_bytevector_s64_set  },
+
 	/* Control features */
 
 	{ "procedure?",    impl_procedurep                },
@@ -1882,21 +2617,36 @@ struct primitive the_primitives[] = {
 
 	{ "open-input-file",     impl_open_input_file     },
 	{ "open-output-file",    impl_open_output_file    },
+	{ "open-binary-input-file",  impl_open_input_file  },
+	{ "open-binary-output-file", impl_open_output_file },
+	{ "open-input-string",   impl_open_input_string   },
+	{ "open-output-string",  impl_open_output_string  },
+	{ "get-output-string",   impl_get_output_string   },
 
 	{ "close-input-port",    impl_close_input_port    },
 	{ "close-output-port",   impl_close_output_port   },
 
 	{ "read",          impl_read                      },
+	{ "fasl-read",     impl_fasl_read                 },
 	{ "read-char",     impl_read_char                 },
 	{ "peek-char",     impl_peek_char                 },
+	{ "read-line",     impl_read_line                 },
+	{ "read-string",   impl_read_string               },
+	{ "read-bytevector",  impl_read_bytevector        },
+	{ "read-bytevector!", impl_read_bytevector_x      },
 
 	{ "eof-object?",   impl_eofp                      },
 //	{ "char-ready?",   impl_char_readyp               },
 
 	{ "write",         impl_write                     },
+	{ "write-shared",  impl_write_shared              },
+	{ "fasl-write",    impl_fasl_write                },
 	{ "display",       impl_display                   },
 	{ "newline",       impl_newline                   },
 	{ "write-char",    impl_write_char                },
+	{ "write-string",  impl_write_string              },
+	{ "write-bytevector", impl_write_bytevector       },
+	{ "flush-output-port", impl_flush_output_port     },
 
 
 	/* System interface */
@@ -1907,11 +2657,35 @@ struct primitive the_primitives[] = {
 	/* Misc extensions */
 	{ "error",         impl_error                     },
 	{ "gensym",        impl_gensym                    },
+	{ "gc",            impl_gc                        },
+
+	{ "make-weak-box",           impl_make_weak_box          },
+	{ "weak-box?",               impl_weak_boxp              },
+	{ "weak-box-value",          impl_weak_box_value         },
+	{ "weak-box-set!",           impl_weak_box_set           },
+	{ "make-ephemeron",          impl_make_ephemeron         },
+	{ "ephemeron?",              impl_ephemeronp             },
+	{ "ephemeron-key",           impl_ephemeron_key          },
+	{ "ephemeron-value",         impl_ephemeron_value        },
+	{ "ephemeron-broken?",       impl_ephemeron_brokenp      },
+	{ "make-weak-hash-table",    impl_make_weak_hash_table   },
+	{ "weak-hash-table?",        impl_weak_hash_tablep       },
+	{ "weak-hash-table-ref",     impl_weak_hash_table_ref    },
+	{ "weak-hash-table-set!",    impl_weak_hash_table_set    },
+	{ "weak-hash-table-delete!", impl_weak_hash_table_delete },
+	{ "weak-hash-table-count",   impl_weak_hash_table_count  },
 
 	{ "break",         lisp_primitive_break           },
 	{ "time-call",     lisp_primitive_timecall        },
+	{ "with-region",   lisp_primitive_with_region     },
 	{ "pmacro",        lisp_primitive_pmacro          },
 	{ "macroexpand",   lisp_primitive_macroexpand     },
 
+	/* transformers are plain values, so these are their ordinary counterparts */
+	{ "define-syntax", lisp_primitive_define          },
+	{ "let-syntax",    lisp_primitive_let             },
+	{ "letrec-syntax", lisp_primitive_letrec          },
+	{ "syntax-rules",  lisp_primitive_syntax_rules    },
+
 	{ NULL, NULL }
 };
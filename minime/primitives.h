@@ -41,9 +41,12 @@ extern object lisp_primitive_delay(object args);
 extern object lisp_primitive_quasiquote(object args);
 
 extern object lisp_primitive_timecall(object args);
+extern object lisp_primitive_with_region(object args);
 
 extern object lisp_primitive_break(object args);
 extern object lisp_primitive_pmacro(object args);
 extern object lisp_primitive_macroexpand(object args);
 
+extern object lisp_primitive_syntax_rules(object args);
+
 #endif
@@ -12,91 +12,173 @@
 #define HEAP_SIZE (128 * 1024 * 1024)
 unsigned long heap_size = HEAP_SIZE;
 
-static unsigned long *heap, *freeptr;
+#define make_indirect(p) ((object) ((unsigned long) (p) | INDIRECT_TAG))
 
 object make_the_empty_list()
 {
-	*freeptr++ = EMPTY_LIST_TAG;
-	return (object) ((unsigned long) (freeptr - 1) | INDIRECT_TAG);
+	unsigned long *p = gc_alloc(1);
+
+	p[0] = EMPTY_LIST_TAG;
+	return make_indirect(p);
 }
 
 object make_the_eof()
 {
-	*freeptr++ = END_OF_FILE_TAG;
-	return (object) ((unsigned long) (freeptr - 1) | INDIRECT_TAG);
+	unsigned long *p = gc_alloc(1);
+
+	p[0] = END_OF_FILE_TAG;
+	return make_indirect(p);
 }
 
 object make_the_unspecified_value()
 {
-	*freeptr++ = UNSPECIFIED_VALUE_TAG;
-	return (object) ((unsigned long) (freeptr - 1) | INDIRECT_TAG);
+	unsigned long *p = gc_alloc(1);
+
+	p[0] = UNSPECIFIED_VALUE_TAG;
+	return make_indirect(p);
 }
 
-object make_port(FILE *in, unsigned long port_type)
+object make_port(struct port *implementation, unsigned long port_type)
 {
-	*freeptr++ = PORT_TAG;
-	*freeptr++ = (port_type & PORT_TYPE_MASK);
-	*freeptr++ = (unsigned long) in;
+	unsigned long *p = gc_alloc(3);
+
+	p[0] = PORT_TAG;
+	p[1] = (port_type & PORT_TYPE_MASK);
+	p[2] = (unsigned long) implementation;
 
-	return (object) ((unsigned long) (freeptr - 3) | INDIRECT_TAG);
+	return make_indirect(p);
 }
 
 object make_boolean(int val)
 {
-	*freeptr++ = BOOLEAN_TAG | (val << BOOLEAN_SHIFT);
-	return (object) ((unsigned long) (freeptr - 1) | INDIRECT_TAG);
+	unsigned long *p = gc_alloc(1);
+
+	p[0] = BOOLEAN_TAG | (val << BOOLEAN_SHIFT);
+	return make_indirect(p);
 }
 
-object make_foreign_ptr(void *ptr)
+object make_foreign_ptr(void *ptr, void (*release)(void *))
 {
-	*freeptr++ = FOREIGN_PTR_TAG;
-	*freeptr++ = (unsigned long) ptr;
+	unsigned long *p, depth;
+	object o;
+
+	/* a finalized object has to be in the heap, where it is seen dying */
+	depth = gc_region_suspend();
+
+	p = gc_alloc(2);
+	p[0] = FOREIGN_PTR_TAG;
+	p[1] = (unsigned long) ptr;
+	o = make_indirect(p);
+
+	if (release != NULL)
+		gc_register_finalizer(o, release, ptr);
 
-	return (object) ((unsigned long) (freeptr - 2) | INDIRECT_TAG);
+	gc_region_resume(depth);
+	return o;
 }
 
 object make_primitive(primitive_proc primitive)
 {
-	*freeptr++ = PRIMITIVE_PROC_TAG;
-	*freeptr++ = (unsigned long) primitive;
+	unsigned long *p = gc_alloc(2);
+
+	p[0] = PRIMITIVE_PROC_TAG;
+	p[1] = (unsigned long) primitive;
+
+	return make_indirect(p);
+}
+
+object make_procedure(object parameters, object body, object environment, object cells)
+{
+	unsigned long *p = gc_alloc(5);
 
-	return (object) ((unsigned long) (freeptr - 2) | INDIRECT_TAG);
+	p[0] = PROCEDURE_TAG;
+	p[1] = (unsigned long) parameters;
+	p[2] = (unsigned long) body;
+	p[3] = (unsigned long) environment;
+	p[4] = (unsigned long) cells;
+
+	return make_indirect(p);
 }
 
-object make_procedure(object parameters, object body, object environment)
+object make_cell(object value)
 {
-	*freeptr++ = PROCEDURE_TAG;
-	*freeptr++ = (unsigned long) parameters;
-	*freeptr++ = (unsigned long) body;
-	*freeptr++ = (unsigned long) environment;
+	unsigned long *p = gc_alloc(2);
+
+	p[0] = CELL_TAG;
+	p[1] = (unsigned long) value;
 
-	return (object) ((unsigned long) (freeptr - 4) | INDIRECT_TAG);
+	return make_indirect(p);
 }
 
 object make_macro(object parameters, object body, object environment)
 {
-	*freeptr++ = MACRO_TAG;
-	*freeptr++ = (unsigned long) parameters;
-	*freeptr++ = (unsigned long) body;
-	*freeptr++ = (unsigned long) environment;
+	unsigned long *p = gc_alloc(4);
 
-	return (object) ((unsigned long) (freeptr - 4) | INDIRECT_TAG);
+	p[0] = MACRO_TAG;
+	p[1] = (unsigned long) parameters;
+	p[2] = (unsigned long) body;
+	p[3] = (unsigned long) environment;
+
+	return make_indirect(p);
 }
 
-object make_string(unsigned long length)
+object make_weak_box(object value)
 {
-	unsigned long words;
+	unsigned long *p = gc_alloc(2);
 
-	*freeptr++ = STRING_TAG | (length << STRING_SHIFT);
+	p[0] = WEAK_BOX_TAG;
+	p[1] = (unsigned long) value;
 
-	/* null-terminate */
-	*((unsigned char *) freeptr + length) = 0;
+	return make_indirect(p);
+}
+
+object make_ephemeron(object key, object value)
+{
+	unsigned long *p = gc_alloc(3);
+
+	p[0] = EPHEMERON_TAG;
+	p[1] = (unsigned long) key;
+	p[2] = (unsigned long) value;
+
+	return make_indirect(p);
+}
+
+object make_weak_table(unsigned long size)
+{
+	object buckets = make_vector(size, nil);
+	unsigned long *p = gc_alloc(3);
+
+	p[0] = WEAK_TABLE_TAG;
+	p[1] = (unsigned long) buckets;
+	p[2] = (unsigned long) make_fixnum(0);
+
+	return make_indirect(p);
+}
+
+object make_syntax_rules(object literals, object rules)
+{
+	unsigned long *p = gc_alloc(3);
+
+	p[0] = SYNTAX_RULES_TAG;
+	p[1] = (unsigned long) literals;
+	p[2] = (unsigned long) rules;
+
+	return make_indirect(p);
+}
+
+object make_string(unsigned long length)
+{
+	unsigned long *p;
 
 	/* round length + 1 to full word */
-	words = (length + sizeof(unsigned long)) / sizeof(unsigned long);
-	freeptr += words;
+	p = gc_alloc(1 + (length + sizeof(unsigned long)) / sizeof(unsigned long));
+
+	p[0] = STRING_TAG | (length << STRING_SHIFT);
 
-	return (object) ((unsigned long) (freeptr - words - 1) | INDIRECT_TAG);
+	/* null-terminate */
+	*((unsigned char *) (p + 1) + length) = 0;
+
+	return make_indirect(p);
 }
 
 object make_string_buffer(char *str, unsigned long length)
@@ -111,16 +193,27 @@ object make_string_c(char *str)
 	return make_string_buffer(str, strlen(str));
 }
 
+object make_bytevector(unsigned long length)
+{
+	unsigned long *p;
+
+	p = gc_alloc(1 + (length + sizeof(unsigned long) - 1) / sizeof(unsigned long));
+
+	p[0] = BYTEVECTOR_TAG | (length << BYTEVECTOR_SHIFT);
+
+	return make_indirect(p);
+}
+
 object make_vector(unsigned long length, object fill)
 {
-	unsigned long i;
+	unsigned long *p = gc_alloc(1 + ref_words(length));
 
-	*freeptr++ = VECTOR_TAG | (length << VECTOR_SHIFT);
+	p[0] = VECTOR_TAG | (length << VECTOR_SHIFT);
 
-	for (i = 0; i < length; i++)
-		*freeptr++ = (unsigned long) fill;
+	/* large vectors are allocated black during marking */
+	vector_fill(make_indirect(p), fill);
 
-	return (object) ((unsigned long) (freeptr - length - 1) | INDIRECT_TAG);
+	return make_indirect(p);
 }
 
 object make_symbol(char *str, unsigned long len)
@@ -128,21 +221,53 @@ object make_symbol(char *str, unsigned long len)
 	return symbol(str, len);
 }
 
-object make_symbol_with_string(object o)
+object make_symbol_with_string(object o, unsigned long hash)
 {
-	*freeptr++ = SYMBOL_TAG;
-	*freeptr++ = (unsigned long) o;
+	unsigned long *p = gc_alloc(3);
 
-	return (object) ((unsigned long) (freeptr - 2) | INDIRECT_TAG);
+	p[0] = SYMBOL_TAG;
+	p[1] = (unsigned long) o;
+	p[2] = hash;
+
+	return make_indirect(p);
 }
 
 object cons(object car_value, object cdr_value)
 {
-	*freeptr++ = (unsigned long) car_value;
-	*freeptr++ = (unsigned long) cdr_value;
+#if COMPRESSED_POINTERS
+	object_ref *p = (object_ref *) gc_alloc_pair();
+
+	/* a box made for a fixnum is only kept by the pair, which can't
+	   hold garbage meanwhile */
+	p[0] = p[1] = compress(nil);
+	p[0] = compress(car_value);
+	p[1] = compress(cdr_value);
+#else
+	unsigned long *p = gc_alloc_pair();
+
+	p[0] = (unsigned long) car_value;
+	p[1] = (unsigned long) cdr_value;
+#endif
+
+	return (object) ((unsigned long) p | PAIR_TAG);
+}
+
+#if COMPRESSED_POINTERS
+/* in the heap even inside a region, a heap pair may refer to it */
+object_ref box_fixnum(object o)
+{
+	unsigned long *p, depth;
+
+	depth = gc_region_suspend();
+	p = gc_alloc(2);
+	gc_region_resume(depth);
+
+	p[0] = BOXED_FIXNUM_TAG;
+	p[1] = (unsigned long) o;
 
-	return (object) ((unsigned long) (freeptr - 2) | PAIR_TAG);
+	return (object_ref) ((char *) p - gc_window) | BOXED_FIXNUM_REF;
 }
+#endif
 
 object safe_car(object o)
 {
@@ -237,6 +362,9 @@ object_type type_of(object o)
 	if (is_string(o))
 		return T_STRING;
 
+	if (is_bytevector(o))
+		return T_BYTEVECTOR;
+
 	if (is_vector(o))
 		return T_VECTOR;
 
@@ -264,6 +392,21 @@ object_type type_of(object o)
 	if (is_macro(o))
 		return T_MACRO;
 
+	if (is_syntax_rules(o))
+		return T_SYNTAX_RULES;
+
+	if (is_weak_box(o))
+		return T_WEAK_BOX;
+
+	if (is_ephemeron(o))
+		return T_EPHEMERON;
+
+	if (is_weak_table(o))
+		return T_WEAK_TABLE;
+
+	if (is_cell(o))
+		return T_CELL;
+
 	error("Uknown object type -- TYPE-OF", o);
 	return T_NIL; /* not reached */
 }
@@ -271,21 +414,20 @@ object_type type_of(object o)
 
 void runtime_init()
 {
-	if (posix_memalign((void **) &heap, sizeof(unsigned long), heap_size))
-		FATAL("failed to allocate heap");
-
-	freeptr = heap;
+	gc_init(heap_size);
 }
 
 void runtime_stats()
 {
-	fprintf(stderr, "Used %zd heap bytes.\n", (freeptr - heap) * sizeof(unsigned long));
+	gc_stats();
 	symbol_table_stats();
+	memo_table_stats();
 }
 
+/* allocated so far, collecting doesn't make it go down */
 unsigned long runtime_current_heap_usage()
 {
-	return (freeptr - heap) * sizeof(unsigned long);
+	return gc_allocated_bytes();
 }
 
 /* as a fixnum, this will wrap in about 3 days on 32 bit */
@@ -54,9 +54,78 @@ static inline int is_null(object o)
 
 extern object make_the_empty_list();
 
+/* Built with COMPRESSED_POINTERS, pairs and vector slots hold 32 bit
+   references instead of objects. Characters and fixnums that fit in 30
+   bits are kept as they are, heap objects as their offset from
+   gc_window, tag included. Objects start on 8 byte boundaries, so bit
+   2 of an offset is free to say the object is a box holding a fixnum
+   too big for a reference. Everywhere else objects are full words. */
+
+#define BOXED_FIXNUM_TAG  0x2FUL	     /* never seen outside references */
+
+#if COMPRESSED_POINTERS
+
+typedef unsigned int object_ref;
+
+#define BOXED_FIXNUM_REF 7U
+
+extern object_ref box_fixnum(object o);
+
+static inline object_ref compress(object o)
+{
+	unsigned long u = (unsigned long) o;
+
+	/* pairs and indirect objects */
+	if (u & 2)
+		return (object_ref) (u - (unsigned long) gc_window);
+
+	if ((long) (int) u != (long) u)
+		return box_fixnum(o);
+
+	return (object_ref) u;
+}
+
+/* for the collector, a box is not its fixnum */
+static inline object referenced_object(object_ref r)
+{
+	if (r & 2)
+		return (object) ((unsigned long) gc_window + (r & ~4U));
+
+	return (object) (long) (int) r;
+}
+
+static inline object decompress(object_ref r)
+{
+	if ((r & 7) == BOXED_FIXNUM_REF)
+		return (object) ((unsigned long *) (gc_window + (r & ~7U)))[1];
+
+	if (r & 2)
+		return (object) (gc_window + r);
+
+	return (object) (long) (int) r;
+}
+
+#else
+
+typedef object object_ref;
+
+#define compress(o)          (o)
+#define decompress(r)        (r)
+#define referenced_object(r) (r)
+
+#endif
+
+/* the words taken by n references */
+static inline unsigned long ref_words(unsigned long n)
+{
+	return (n * sizeof(object_ref) + sizeof(unsigned long) - 1) / sizeof(unsigned long);
+}
+
 #define PAIR_TAG   2UL
 #define PAIR_MASK  3UL
 
+#define PAIR_WORDS (2 * sizeof(object_ref) / sizeof(unsigned long))
+
 extern object cons(object car_value, object cdr_value);
 
 static inline int is_pair(object o)
@@ -69,12 +138,12 @@ extern object safe_cdr(object o);
 
 static inline object fast_car(object o)
 {
-	return ((object *)((unsigned long) o - PAIR_TAG))[0];
+	return decompress(((object_ref *)((unsigned long) o - PAIR_TAG))[0]);
 }
 
 static inline object fast_cdr(object o)
 {
-	return ((object *)((unsigned long) o - PAIR_TAG))[1];
+	return decompress(((object_ref *)((unsigned long) o - PAIR_TAG))[1]);
 }
 
 #if (SAFETY == 0)
@@ -122,23 +191,29 @@ static inline object fast_cdr(object o)
 
 static inline object set_car(object pair, object o)
 {
+	object_ref r;
 #if SAFETY
 	if (!is_pair(pair))
 		error("Object is not a pair -- set-car!", pair);
 #endif
 
-	((object *)((unsigned long) pair - PAIR_TAG))[0] = o;
+	r = compress(o);
+	gc_write_barrier(pair, o);
+	((object_ref *)((unsigned long) pair - PAIR_TAG))[0] = r;
 	return o;			     /* r5rs return value is unspecified */
 }
 
 static inline object set_cdr(object pair, object o)
 {
+	object_ref r;
 #if SAFETY
 	if (!is_pair(pair))
 		error("Object is not a pair -- set-cdr!", pair);
 #endif
 
-	((object *)((unsigned long) pair - PAIR_TAG))[1] = o;
+	r = compress(o);
+	gc_write_barrier(pair, o);
+	((object_ref *)((unsigned long) pair - PAIR_TAG))[1] = r;
 	return o;			     /* r5rs return value is unspecified */
 }
 
@@ -283,6 +358,47 @@ static inline int string_equal(object s1, object s2)
 }
 
 
+/* like strings, without the terminating null */
+#define BYTEVECTOR_TAG   0UL
+#define BYTEVECTOR_MASK  3UL
+#define BYTEVECTOR_SHIFT 2UL
+
+static inline int is_bytevector(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & BYTEVECTOR_MASK) == BYTEVECTOR_TAG);
+}
+
+extern object make_bytevector(unsigned long length);
+
+static inline unsigned long bytevector_length(object o)
+{
+	unsigned long indirect;
+
+#if SAFETY
+	if (!is_bytevector(o))
+		error("Object is not a bytevector -- BYTEVECTOR-LENGTH", o);
+#endif
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return (indirect - BYTEVECTOR_TAG) >> BYTEVECTOR_SHIFT;
+}
+
+static inline unsigned char *bytevector_value(object o)
+{
+#if SAFETY
+	if (!is_bytevector(o))
+		error("Object is not a bytevector -- BYTEVECTOR-VALUE", o);
+#endif
+
+	return (unsigned char *) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG) + 1);
+}
+
+
 #define VECTOR_TAG   1UL
 #define VECTOR_MASK  3UL
 #define VECTOR_SHIFT 2UL
@@ -312,17 +428,17 @@ static inline unsigned long vector_length(object vec)
 	return (indirect - VECTOR_TAG) >> VECTOR_SHIFT;
 }
 
-static inline object *vector_ptr(object vec)
+static inline object_ref *vector_ptr(object vec)
 {
 #if SAFETY
 	if (!is_vector(vec))
 		error("Object is not a vector -- vector-ref", vec);
 #endif
 
-	return (object *) ((unsigned long *) ((unsigned long) vec - INDIRECT_TAG) + 1);
+	return (object_ref *) ((unsigned long *) ((unsigned long) vec - INDIRECT_TAG) + 1);
 }
 
-static inline object *vector_ptr_ref(object vec, long k)
+static inline object_ref *vector_ptr_ref(object vec, long k)
 {
 #if SAFETY
 	if (!is_vector(vec))
@@ -337,48 +453,70 @@ static inline object *vector_ptr_ref(object vec, long k)
 
 static inline object vector_ref(object vec, long k)
 {
-	return *(vector_ptr_ref(vec, k));
+	return decompress(*(vector_ptr_ref(vec, k)));
+}
+
+static inline void vector_set(object vec, long k, object o)
+{
+	object_ref r = compress(o);
+
+	gc_write_barrier(vec, o);
+	*(vector_ptr_ref(vec, k)) = r;
 }
 
 
 static inline void vector_fill(object vec, object fill)
 {
 	unsigned long i, length;
-	object *vptr;
+	object_ref *vptr, r;
 #if SAFETY
 	if (!is_vector(vec))
 		error("Object is not a vector -- vector-fill", vec);
 #endif
 
 	length = vector_length(vec);
+	r      = compress(fill);
 	vptr   = vector_ptr(vec);
 
+	gc_write_barrier(vec, fill);
+
 	for (i = 0; i < length; i++)
-		*vptr++ = fill;
+		*vptr++ = r;
 }
 
 
 static inline object list_to_vector(object lst)
 {
 	object vec;
-	object *vptr;
+	long k = 0;
 
 #if SAFETY
 	if (!is_list(lst))
 		error("Object is not a list", lst);
 #endif
 
-	vec  = make_vector(length(lst), nil);
-	vptr = vector_ptr(vec);
+	vec = make_vector(length(lst), nil);
 
 	while (!is_null(lst)) {
-		*vptr++ = car(lst);
+		vector_set(vec, k++, car(lst));
 		lst = cdr(lst);
 	}
 
 	return vec;
 }
 
+/* the elements are known to be bytes */
+static inline object list_to_bytevector(object lst)
+{
+	object bv = make_bytevector(length(lst));
+	unsigned char *p = bytevector_value(bv);
+
+	for (; !is_null(lst); lst = cdr(lst))
+		*p++ = fixnum_value(car(lst));
+
+	return bv;
+}
+
 #define SYMBOL_TAG  0xBFUL
 #define SYMBOL_MASK 0xFFUL
 
@@ -394,7 +532,10 @@ static inline int is_symbol(object o)
 }
 
 extern object make_symbol(char *str, unsigned long len);
-extern object make_symbol_with_string(object o);
+extern object make_symbol_with_string(object o, unsigned long hash);
+
+/* uninterned symbols hold a fixnum until their name is needed */
+extern object gensym_name(object o);
 
 static inline object make_symbol_c(char *str)
 {
@@ -403,12 +544,24 @@ static inline object make_symbol_c(char *str)
 
 static inline object symbol_string(object o)
 {
+	object name;
+
 #if SAFETY
 	if (!is_symbol(o))
 		error("Object is not a symbol -- SYMBOL-STRING", o);
 #endif
 
-	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+	name = (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+	if (is_fixnum(name))
+		return gensym_name(o);
+
+	return name;
+}
+
+/* stable for the life of the symbol, usable by any eq? table */
+static inline unsigned long symbol_hash(object o)
+{
+	return ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2];
 }
 
 static inline int is_expression_keyword(object o)
@@ -469,7 +622,8 @@ static inline int is_foreign_ptr(object o)
 	return ((indirect & FOREIGN_PTR_MASK) == FOREIGN_PTR_TAG);
 }
 
-extern object make_foreign_ptr(void *ptr);
+/* release, if not NULL, is called on ptr once the object is unreachable */
+extern object make_foreign_ptr(void *ptr, void (*release)(void *));
 
 static inline void *foreign_ptr_value(object o)
 {
@@ -536,7 +690,7 @@ static inline int is_procedure(object o)
 	return ((indirect & PROCEDURE_MASK) == PROCEDURE_TAG);
 }
 
-extern object make_procedure(object parameters, object body, object environment);
+extern object make_procedure(object parameters, object body, object environment, object cells);
 
 static inline object procedure_parameters(object o)
 {
@@ -569,6 +723,46 @@ static inline object procedure_environment(object o)
 	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [3];
 }
 
+/* the parameters put in cells when bound, those something assigns to */
+static inline object procedure_cells(object o)
+{
+#if SAFETY
+	if (!is_procedure(o))
+		error("Object is not a procedure -- APPLY", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [4];
+}
+
+/* A cell holds the value of a variable shared between closures, see
+   environments.c. It never gets out to the program. */
+#define CELL_TAG  0x0FUL
+#define CELL_MASK 0xFFUL
+
+static inline int is_cell(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & CELL_MASK) == CELL_TAG);
+}
+
+extern object make_cell(object value);
+
+static inline object cell_value(object o)
+{
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+}
+
+static inline void set_cell_value(object o, object value)
+{
+	gc_write_barrier(o, value);
+	((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1] = (unsigned long) value;
+}
+
 static inline int is_anykind_procedure(object o)
 {
 	return is_primitive(o) || is_procedure(o);
@@ -594,7 +788,7 @@ static inline int is_port(object o)
 	return ((indirect & PORT_MASK) == PORT_TAG);
 }
 
-extern object make_port(FILE *in, unsigned long port_type);
+extern object make_port(struct port *implementation, unsigned long port_type);
 
 static inline int is_input_port(object o)
 {
@@ -603,23 +797,23 @@ static inline int is_input_port(object o)
 		error("Object is not a port -- input-port?", o);
 #endif
 
-	return PORT_TYPE_INPUT == (PORT_TYPE_MASK && ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1]);
+	return PORT_TYPE_INPUT == (PORT_TYPE_MASK & ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1]);
 }
 
 static inline int is_output_port(object o)
 {
 #if SAFETY
 	if (!is_port(o))
-		error("Object is not a port -- input-port?", o);
+		error("Object is not a port -- output-port?", o);
 #endif
 
-	return PORT_TYPE_OUTPUT == (PORT_TYPE_MASK && ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1]);
+	return PORT_TYPE_OUTPUT == (PORT_TYPE_MASK & ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1]);
 }
 
 /* unsafe */
 static inline unsigned long get_port_flags(object o)
 {
-	return PORT_FLAGS_MASK && ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1];
+	return PORT_FLAGS_MASK & ((unsigned long *) ((unsigned long) o - INDIRECT_TAG))[1];
 }
 
 /* unsafe */
@@ -641,14 +835,14 @@ static inline void set_port_closed(object o)
 	set_port_flags(o, PORT_FLAG_CLOSED | get_port_flags(o));
 }
 
-static inline FILE *port_implementation(object o)
+static inline struct port *port_implementation(object o)
 {
 #if SAFETY
 	if (!is_port(o))
 		error("Object is not a port -- port-implementation", o);
 #endif
 
-	return (FILE *) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2];
+	return (struct port *) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2];
 }
 
 #define END_OF_FILE_TAG  0x1FUL
@@ -731,6 +925,177 @@ static inline object macro_environment(object o)
 	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [3];
 }
 
+#define SYNTAX_RULES_TAG  0xAFUL
+#define SYNTAX_RULES_MASK 0xFFUL
+
+static inline int is_syntax_rules(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & SYNTAX_RULES_MASK) == SYNTAX_RULES_TAG);
+}
+
+extern object make_syntax_rules(object literals, object rules);
+
+static inline object syntax_rules_literals(object o)
+{
+#if SAFETY
+	if (!is_syntax_rules(o))
+		error("Object is not a syntax-rules transformer", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+}
+
+/* a vector of compiled rules, see syntax.c */
+static inline object syntax_rules_rules(object o)
+{
+#if SAFETY
+	if (!is_syntax_rules(o))
+		error("Object is not a syntax-rules transformer", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2];
+}
+
+/* The collector doesn't keep the value of a weak box alive, and
+   breaks the box (the value becomes #f) once nothing else does. */
+#define WEAK_BOX_TAG  0x4FUL
+#define WEAK_BOX_MASK 0xFFUL
+
+static inline int is_weak_box(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & WEAK_BOX_MASK) == WEAK_BOX_TAG);
+}
+
+extern object make_weak_box(object value);
+
+static inline object weak_box_value(object o)
+{
+#if SAFETY
+	if (!is_weak_box(o))
+		error("Object is not a weak box -- WEAK-BOX-VALUE", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+}
+
+static inline void set_weak_box_value(object o, object value)
+{
+#if SAFETY
+	if (!is_weak_box(o))
+		error("Object is not a weak box -- WEAK-BOX-SET!", o);
+#endif
+
+	gc_write_barrier(o, value);
+	((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1] = (unsigned long) value;
+}
+
+/* An ephemeron keeps its value alive only as long as something else
+   keeps its key. When the key dies, both are dropped and it is broken. */
+#define EPHEMERON_TAG    0x8FUL
+#define EPHEMERON_MASK   0xFFUL
+#define EPHEMERON_BROKEN 0x100UL
+
+static inline int is_ephemeron(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & EPHEMERON_MASK) == EPHEMERON_TAG);
+}
+
+extern object make_ephemeron(object key, object value);
+
+static inline int is_ephemeron_broken(object o)
+{
+#if SAFETY
+	if (!is_ephemeron(o))
+		error("Object is not an ephemeron -- EPHEMERON-BROKEN?", o);
+#endif
+
+	return (((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [0] & EPHEMERON_BROKEN) != 0;
+}
+
+static inline object ephemeron_key(object o)
+{
+#if SAFETY
+	if (!is_ephemeron(o))
+		error("Object is not an ephemeron -- EPHEMERON-KEY", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+}
+
+static inline object ephemeron_value(object o)
+{
+#if SAFETY
+	if (!is_ephemeron(o))
+		error("Object is not an ephemeron -- EPHEMERON-VALUE", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2];
+}
+
+static inline void set_ephemeron_value(object o, object value)
+{
+	gc_write_barrier(o, value);
+	((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2] = (unsigned long) value;
+}
+
+/* eq? keyed, the entries are ephemerons in a vector of buckets */
+#define WEAK_TABLE_TAG  0xCFUL
+#define WEAK_TABLE_MASK 0xFFUL
+
+static inline int is_weak_table(object o)
+{
+	unsigned long indirect;
+
+	if (!is_indirect(o))
+		return 0;
+
+	indirect = *(unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	return ((indirect & WEAK_TABLE_MASK) == WEAK_TABLE_TAG);
+}
+
+extern object make_weak_table(unsigned long size);
+
+static inline object weak_table_buckets(object o)
+{
+#if SAFETY
+	if (!is_weak_table(o))
+		error("Object is not a weak hash table", o);
+#endif
+
+	return (object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1];
+}
+
+/* the entries added, some may have been broken since */
+static inline unsigned long weak_table_count(object o)
+{
+	return fixnum_value((object) ((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2]);
+}
+
+static inline void set_weak_table_contents(object o, object buckets, unsigned long count)
+{
+	gc_write_barrier(o, buckets);
+	((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [1] = (unsigned long) buckets;
+	((unsigned long *) ((unsigned long) o - INDIRECT_TAG)) [2] = (unsigned long) make_fixnum(count);
+}
+
 extern object_type type_of(object o);
 
 extern void runtime_init();
@@ -0,0 +1,286 @@
+/* shared.c -- finding the structure an object shares with itself
+
+   A depth first walk over the pairs and vectors of an object, counting
+   them in an open addressed table keyed on their address. Something
+   met again while it is still being walked is part of a cycle. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minime.h"
+
+#define SHARED_TABLE_MIN_SIZE 256
+#define SHARED_STACK_MIN      64
+
+#define SHARED_ACTIVE 1			     /* still being walked */
+#define SHARED_MANY   2			     /* reached more than once */
+#define SHARED_LABEL  2			     /* the label, plus one, above these */
+
+/* the low bits of neighbouring pairs differ little, mix them all in */
+static inline unsigned long shared_hash(object key)
+{
+	unsigned long h = (unsigned long) key;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+static void shared_table_alloc(struct shared_table *table, unsigned long size)
+{
+	table->size   = size;
+	table->count  = 0;
+	table->keys   = xcalloc(size, sizeof(object));
+	table->values = xcalloc(size, sizeof(unsigned long));
+}
+
+void shared_table_init(struct shared_table *table)
+{
+	shared_table_alloc(table, SHARED_TABLE_MIN_SIZE);
+	table->shared = 0;
+	table->cycles = 0;
+	table->labels = 0;
+}
+
+void shared_table_free(struct shared_table *table)
+{
+	xfree(table->keys);
+	xfree(table->values);
+}
+
+static unsigned long shared_slot(struct shared_table *table, object key)
+{
+	unsigned long mask = table->size - 1;
+	unsigned long i = shared_hash(key) & mask;
+
+	while (table->keys[i] != NULL && table->keys[i] != key)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static void shared_table_grow(struct shared_table *table)
+{
+	object *keys = table->keys;
+	unsigned long *values = table->values;
+	unsigned long i, j, old_size = table->size;
+
+	shared_table_alloc(table, 2 * old_size);
+
+	for (i = 0; i < old_size; i++)
+		if (keys[i] != NULL) {
+			j = shared_slot(table, keys[i]);
+			table->keys[j] = keys[i];
+			table->values[j] = values[i];
+			table->count++;
+		}
+
+	xfree(keys);
+	xfree(values);
+}
+
+static inline int is_compound(object o)
+{
+	return is_pair(o) || (is_vector(o) && vector_length(o) > 0);
+}
+
+struct shared_frame {
+	object o;
+	unsigned long next;		     /* the field to walk next */
+	unsigned long slot, size;	     /* where it is, in a table of that size */
+};
+
+/* Returns 1 if o is seen for the first time and needs walking, with
+   the slot to put it in. */
+static int shared_visit(struct shared_table *table, object o, unsigned long *slot)
+{
+	unsigned long i;
+
+	if (!is_compound(o))
+		return 0;
+
+	/* keep the load under one half */
+	if (2 * (table->count + 1) > table->size)
+		shared_table_grow(table);
+
+	i = shared_slot(table, o);
+
+	if (table->keys[i] != NULL) {
+		if (table->values[i] & SHARED_ACTIVE)
+			table->cycles = 1;
+
+		if (!(table->values[i] & SHARED_MANY))
+			table->shared++;
+
+		table->values[i] |= SHARED_MANY;
+		return 0;
+	}
+
+	*slot = i;
+	return 1;
+}
+
+void shared_scan(struct shared_table *table, object exp)
+{
+	struct shared_frame small[SHARED_STACK_MIN], *stack = small, *top;
+	unsigned long depth = 0, size = SHARED_STACK_MIN, i;
+	object next;
+
+	if (!shared_visit(table, exp, &i))
+		return;
+
+	while (1) {
+		/* exp is new, walk it */
+		if (depth == size) {
+			if (stack == small) {
+				stack = xmalloc(2 * size * sizeof(struct shared_frame));
+				memcpy(stack, small, sizeof(small));
+			} else
+				stack = xrealloc(stack, 2 * size * sizeof(struct shared_frame));
+
+			size *= 2;
+		}
+
+		table->keys[i] = exp;
+		table->values[i] = SHARED_ACTIVE;
+		table->count++;
+
+		top = &stack[depth++];
+		top->o = exp;
+		top->next = 0;
+		top->slot = i;
+		top->size = table->size;
+
+		/* find the next new object, finishing off the ones done with */
+		while (depth > 0) {
+			top = &stack[depth - 1];
+
+			if (is_pair(top->o) && top->next < 2)
+				next = top->next++ == 0 ? car(top->o) : cdr(top->o);
+			else if (is_vector(top->o) && top->next < vector_length(top->o))
+				next = vector_ref(top->o, top->next++);
+			else {
+				/* unless the table has grown since */
+				if (top->size != table->size)
+					top->slot = shared_slot(table, top->o);
+
+				table->values[top->slot] &= ~SHARED_ACTIVE;
+				depth--;
+				continue;
+			}
+
+			if (shared_visit(table, next, &i))
+				break;
+		}
+
+		if (depth == 0)
+			break;
+
+		exp = next;
+	}
+
+	if (stack != small)
+		xfree(stack);
+}
+
+/* A quick look for cycles, without a table: a walk down the tree as
+   print would take it. Going round a cycle through a car or a vector
+   only ever gets deeper, and one through cdrs alone is caught by a
+   second pointer going down the list at half the pace. Nothing is
+   visited that printing wouldn't visit anyway. */
+#define QUICK_DEPTH 1024
+
+struct quick_frame {
+	object o;			     /* the pair at hand, or the vector */
+	object slow;			     /* ... half as far down the list */
+	unsigned long next;
+};
+
+int shared_maybe_cyclic(object exp)
+{
+	struct quick_frame stack[QUICK_DEPTH], *top;
+	unsigned long depth = 0;
+	object o;
+
+	while (1) {
+		if (is_compound(exp)) {
+			/* deep enough to be worth the table */
+			if (depth == QUICK_DEPTH)
+				return 1;
+
+			top = &stack[depth++];
+			top->o = top->slow = exp;
+			top->next = 1;
+			exp = is_pair(exp) ? car(exp) : vector_ref(exp, 0);
+			continue;
+		}
+
+		/* what follows it */
+		while (depth > 0) {
+			top = &stack[depth - 1];
+
+			if (is_pair(top->o)) {
+				o = cdr(top->o);
+
+				if (is_pair(o)) {
+					if (top->next++ % 2 == 0)
+						top->slow = cdr(top->slow);
+
+					if (o == top->slow)
+						return 1;
+
+					top->o = o;
+					exp = car(o);
+					break;
+				}
+
+				/* the last cdr is looked at like a car */
+				depth--;
+				exp = o;
+				break;
+			}
+
+			if (top->next < vector_length(top->o)) {
+				exp = vector_ref(top->o, top->next++);
+				break;
+			}
+
+			depth--;
+		}
+
+		if (depth == 0 && !is_compound(exp))
+			return 0;
+	}
+}
+
+int shared_is_shared(struct shared_table *table, object o)
+{
+	unsigned long i;
+
+	if (table->shared == 0 || !is_compound(o))
+		return 0;
+
+	i = shared_slot(table, o);
+	return table->keys[i] != NULL && (table->values[i] & SHARED_MANY);
+}
+
+long shared_label(struct shared_table *table, object o, int *fresh)
+{
+	unsigned long i;
+
+	if (table->shared == 0 || !is_compound(o))
+		return -1;
+
+	i = shared_slot(table, o);
+	if (table->keys[i] == NULL || !(table->values[i] & SHARED_MANY))
+		return -1;
+
+	*fresh = (table->values[i] >> SHARED_LABEL) == 0;
+	if (*fresh)
+		table->values[i] |= ++table->labels << SHARED_LABEL;
+
+	return (table->values[i] >> SHARED_LABEL) - 1;
+}
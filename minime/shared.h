@@ -0,0 +1,32 @@
+#ifndef __SHARED_H
+#define __SHARED_H
+
+/* The pairs and vectors reachable from some object, and which of them
+   are reachable more than once. Addresses are only kept for as long as
+   nothing gets allocated. */
+struct shared_table {
+	unsigned long size;		     /* always a power of two */
+	unsigned long count;
+	object *keys;
+	unsigned long *values;
+
+	unsigned long shared;		     /* how many are reached more than once */
+	int cycles;			     /* some of them lead back to themselves */
+	unsigned long labels;		     /* labels handed out so far */
+};
+
+extern void shared_table_init(struct shared_table *table);
+extern void shared_table_free(struct shared_table *table);
+
+extern void shared_scan(struct shared_table *table, object exp);
+
+/* 0 if exp has no cycles for sure, which is cheap to find out */
+extern int shared_maybe_cyclic(object exp);
+
+extern int  shared_is_shared(struct shared_table *table, object o);
+
+/* The label of o, or -1 when it is only reachable once. *fresh tells
+   whether this is the first time it was asked for. */
+extern long shared_label(struct shared_table *table, object o, int *fresh);
+
+#endif
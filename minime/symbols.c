@@ -1,4 +1,4 @@
-/* symbols.c -- Symbol hashtable. Temporary solution */
+/* symbols.c -- Symbol hashtable */
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -9,11 +9,14 @@
 
 #include "minime.h"
 
-#define SYMBOL_TABLE_BUCKETS 4099
+#define SYMBOL_TABLE_MIN_SIZE 4096
 
+/* open addressing, linear probing. Symbols carry their own hash, so
+   growing never looks at the names again. */
 static struct {
-	unsigned long nbuckets;
-	object *buckets;
+	unsigned long size;		     /* always a power of two */
+	unsigned long count;
+	object *symbols;
 } symbol_table;
 
 static unsigned long gensym_counter = 1;
@@ -29,79 +32,144 @@ static unsigned long symbol_string_hash(char *str, unsigned long len)
 		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
 	}
 
+	/* spread it into the low bits, which pick the slot */
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdUL;
+	hash ^= hash >> 33;
+
 	return hash;
 }
 
-object symbol(char *str, unsigned long len)
+static void symbol_table_alloc(unsigned long size)
+{
+	symbol_table.size    = size;
+	symbol_table.count   = 0;
+	symbol_table.symbols = xcalloc(size, sizeof(object));
+}
+
+/* the empty slot is NULL */
+static unsigned long symbol_table_free_slot(unsigned long hash)
+{
+	unsigned long mask = symbol_table.size - 1;
+	unsigned long i = hash & mask;
+
+	while (symbol_table.symbols[i] != NULL)
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static void symbol_table_grow()
 {
-	unsigned long bucket;
-	object el, o;
-	char *symstr;
-	unsigned long symlen;
+	object *symbols = symbol_table.symbols;
+	unsigned long i, size = symbol_table.size;
+
+	symbol_table_alloc(size * 2);
+
+	for (i = 0; i < size; i++)
+		if (symbols[i] != NULL) {
+			symbol_table.symbols[symbol_table_free_slot(symbol_hash(symbols[i]))] = symbols[i];
+			symbol_table.count++;
+		}
 
-	bucket = symbol_string_hash(str, len) % symbol_table.nbuckets;
-	el = symbol_table.buckets[bucket];
+	xfree(symbols);
+}
 
-	while (!is_null(el)) {
-		o = symbol_string(car(el));
+object symbol(char *str, unsigned long len)
+{
+	unsigned long hash, mask, i, depth;
+	object sym, name;
 
-		symstr = string_value(o);
-		symlen = string_length(o);
+	hash = symbol_string_hash(str, len);
+	mask = symbol_table.size - 1;
 
-		if ((len == symlen) && (memcmp(symstr, str, len) == 0))
-			return car(el);
+	for (i = hash & mask; (sym = symbol_table.symbols[i]) != NULL; i = (i + 1) & mask) {
+		if (symbol_hash(sym) != hash)
+			continue;
 
-		el = cdr(el);
+		name = symbol_string(sym);
+		if (string_length(name) == len && memcmp(string_value(name), str, len) == 0)
+			return sym;
 	}
 
-	/* not there, intern now */
-	o = make_string_buffer(str, len);
-	el = make_symbol_with_string(o);
-	symbol_table.buckets[bucket] = cons(el, symbol_table.buckets[bucket]);
+	/* not there, intern now, and never in a region */
+	depth = gc_region_suspend();
+	sym = make_symbol_with_string(make_string_buffer(str, len), hash);
+	gc_region_resume(depth);
 
+	/* keep the load under one half */
+	if (2 * (symbol_table.count + 1) > symbol_table.size) {
+		symbol_table_grow();
+		i = symbol_table_free_slot(hash);
+	}
+
+	symbol_table.symbols[i] = sym;
+	symbol_table.count++;
 
-	return el;
+	return sym;
 }
 
+/* Generated symbols are never interned, so they don't pile up in the
+   table and nothing read in can be eq? to them. */
 object gensym()
 {
-	char sym[64];
+	unsigned long n = gensym_counter++;
+
+	return make_symbol_with_string(make_fixnum(n), n * 2654435761UL);
+}
+
+object gensym_name(object o)
+{
+	unsigned long *sym = (unsigned long *) ((unsigned long) o - INDIRECT_TAG);
+	unsigned long depth;
+	object string;
+	char name[64];
 	int n;
 
-	n = snprintf(sym, 64, "#:G%lu", gensym_counter++);
+	/* the symbol may be older than the current region */
+	n = snprintf(name, 64, "#:G%ld", fixnum_value((object) sym[1]));
+
+	depth  = gc_region_suspend();
+	string = make_string_buffer(name, n);
+	gc_region_resume(depth);
+
+	gc_write_barrier(o, string);
+	sym[1] = (unsigned long) string;
 
-	return symbol(sym, n);
+	return string;
 }
 
 
 void symbol_table_init()
 {
-	unsigned long i;
+	symbol_table_alloc(SYMBOL_TABLE_MIN_SIZE);
+}
 
-	symbol_table.nbuckets = SYMBOL_TABLE_BUCKETS;
-	symbol_table.buckets  = xmalloc(SYMBOL_TABLE_BUCKETS * sizeof(object));
+/* interned symbols live forever */
+void symbol_table_mark()
+{
+	unsigned long i;
 
-	for (i = 0; i < SYMBOL_TABLE_BUCKETS; i++)
-		symbol_table.buckets[i] = nil;
+	for (i = 0; i < symbol_table.size; i++)
+		if (symbol_table.symbols[i] != NULL)
+			gc_mark(symbol_table.symbols[i]);
 }
 
 void symbol_table_stats()
 {
-	unsigned long i;
-	unsigned long nel, total = 0;
-
-	fprintf(stderr, "Symbol table: %lu buckets\n", symbol_table.nbuckets);
+	unsigned long i, mask = symbol_table.size - 1;
+	unsigned long probes, total = 0, longest = 0;
 
-	for (i = 0; i < symbol_table.nbuckets; i++) {
-		nel = length(symbol_table.buckets[i]);
-		if (nel > 1) {
-			fprintf(stderr, "    bucket %lu: %lu entries ", i, nel);
-			lisp_print(symbol_table.buckets[i], stderr);
-			fprintf(stderr, "\n");
-		}
+	for (i = 0; i < symbol_table.size; i++) {
+		if (symbol_table.symbols[i] == NULL)
+			continue;
 
-		total += nel;
+		probes = ((i - symbol_hash(symbol_table.symbols[i])) & mask) + 1;
+		longest = MAX(longest, probes);
+		total += probes;
 	}
 
-	fprintf(stderr, "Number of symbols: %lu\n", total);
+	fprintf(stderr, "Symbol table: %lu symbols in %lu slots, %.2f probes average, %lu longest\n",
+		symbol_table.count, symbol_table.size,
+		symbol_table.count ? (double) total / symbol_table.count : 0.0, longest);
 }
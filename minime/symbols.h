@@ -6,6 +6,7 @@ extern object symbol(char *str, unsigned long len);
 extern object gensym();
 
 extern void symbol_table_init();
+extern void symbol_table_mark();
 extern void symbol_table_stats();
 
 #endif
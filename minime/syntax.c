@@ -0,0 +1,779 @@
+/* syntax.c -- syntax-rules transformers
+
+   Every rule is compiled once, when the syntax-rules expression is
+   evaluated. The pattern becomes matcher code that binds pattern
+   variables to numbered slots, the template becomes code for a small
+   stack machine that builds the expansion out of those slots. Parts
+   of a template without pattern variables are kept as constants and
+   shared by all expansions.
+
+   Identifiers the template binds with lambda, let, let*, letrec or do
+   are renamed to fresh symbols on every expansion, so they can't
+   capture variables at the use site. That is all the hygiene there
+   is. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <assert.h>
+
+#include "minime.h"
+
+enum {
+	/* matcher, works on a current object */
+	M_PAIR,		/* descend into the car, remembering the cdr */
+	M_NEXT,		/* continue with the last remembered cdr */
+	M_NIL,
+	M_ANY,
+	M_LITERAL,	/* identifier */
+	M_DATUM,	/* datum, compared with equal? */
+	M_BIND,		/* slot */
+	M_VECTOR,
+	M_ELLIPSIS,	/* tail length, first slot, slot count, body length, body */
+
+	/* template, leaves its result on a stack */
+	TPL_CONST,	/* object */
+	TPL_VAR,	/* slot */
+	TPL_RENAME,	/* rename index */
+	TPL_CONS,
+	TPL_APPEND,
+	TPL_VECTOR,
+	TPL_ELLIPSIS,	/* slot count, slots, body length, body */
+	TPL_SPLICE,	/* runs together the lists in the list on top */
+};
+
+/* a compiled rule is a vector of these */
+enum {
+	RULE_SLOTS, RULE_RENAMES,
+	RULE_MATCH_DEPTH, RULE_MATCHER,
+	RULE_STACK_DEPTH, RULE_TEMPLATE,
+
+	RULE_SIZE
+};
+
+struct code {
+	object *ops;
+	long len, size;
+
+	long depth, max_depth;		     /* of the match or template stack */
+};
+
+struct compiler {
+	object spec;
+	object ellipsis;
+	object literals;
+	object vars;			     /* ((name slot . depth) ...) */
+	object renames;			     /* (name ...), index is the position */
+	object temporaries;		     /* lists made from vectors, the code refers to them */
+	long nslots;
+};
+
+static object _underscore;
+
+static void code_init(struct code *code)
+{
+	code->len = code->size = 0;
+	code->ops = NULL;
+	code->depth = code->max_depth = 0;
+}
+
+static void emit(struct code *code, object op)
+{
+	if (code->len == code->size) {
+		code->size = code->size ? 2 * code->size : 32;
+		code->ops  = xrealloc(code->ops, code->size * sizeof(object));
+	}
+
+	code->ops[code->len++] = op;
+}
+
+#define emit_op(code, op) emit(code, make_fixnum(op))
+
+static void stack_change(struct code *code, long delta)
+{
+	code->depth += delta;
+	code->max_depth = MAX(code->max_depth, code->depth);
+}
+
+/* body code follows its length */
+static void emit_body(struct code *code, struct code *body)
+{
+	long i;
+
+	emit(code, make_fixnum(body->len));
+	for (i = 0; i < body->len; i++)
+		emit(code, body->ops[i]);
+
+	code->max_depth = MAX(code->max_depth, code->depth + body->max_depth);
+	xfree(body->ops);
+}
+
+static object code_to_vector(struct code *code)
+{
+	object vec = make_vector(code->len, nil);
+	unsigned long i;
+
+	for (i = 0; i < code->len; i++)
+		vector_set(vec, i, code->ops[i]);
+	xfree(code->ops);
+
+	return vec;
+}
+
+static object vector_to_list(object vec)
+{
+	object lst = nil;
+	long i;
+
+	for (i = vector_length(vec) - 1; i >= 0; i--)
+		lst = cons(vector_ref(vec, i), lst);
+
+	return lst;
+}
+
+static object reverse_list(object lst)
+{
+	object rev = nil;
+
+	for (; !is_null(lst); lst = cdr(lst))
+		rev = cons(car(lst), rev);
+
+	return rev;
+}
+
+static int is_member(object o, object lst)
+{
+	for (; is_pair(lst); lst = cdr(lst))
+		if (car(lst) == o)
+			return 1;
+
+	return 0;
+}
+
+static object pattern_variable(struct compiler *c, object name)
+{
+	object var;
+
+	for (var = c->vars; !is_null(var); var = cdr(var))
+		if (caar(var) == name)
+			return car(var);
+
+	return nil;
+}
+
+#define variable_slot(var)  fixnum_value(cadr(var))
+#define variable_depth(var) fixnum_value(cddr(var))
+
+static int is_ellipsis_follower(struct compiler *c, object pat)
+{
+	return is_pair(cdr(pat)) && cadr(pat) == c->ellipsis;
+}
+
+
+/* Patterns */
+
+static void compile_pattern(struct compiler *c, struct code *code, object pat, long depth)
+{
+	struct code body;
+	object tail;
+	long tail_len, first_slot;
+
+	if (is_symbol(pat)) {
+		if (is_member(pat, c->literals)) {
+			emit_op(code, M_LITERAL);
+			emit(code, pat);
+		} else if (pat == _underscore) {
+			emit_op(code, M_ANY);
+		} else if (pat == c->ellipsis) {
+			error("Misplaced ellipsis -- syntax-rules", c->spec);
+		} else {
+			if (!is_null(pattern_variable(c, pat)))
+				error("Duplicate pattern variable -- syntax-rules", pat);
+
+			c->vars = cons(cons(pat, cons(make_fixnum(c->nslots), make_fixnum(depth))),
+				       c->vars);
+
+			emit_op(code, M_BIND);
+			emit(code, make_fixnum(c->nslots++));
+		}
+	}
+	/* (pat <ellipsis> . tail) */
+	else if (is_pair(pat) && is_ellipsis_follower(c, pat)) {
+		tail = cddr(pat);
+		for (tail_len = 0; is_pair(tail); tail = cdr(tail))
+			tail_len++;
+
+		first_slot = c->nslots;
+
+		code_init(&body);
+		compile_pattern(c, &body, car(pat), depth + 1);
+
+		emit_op(code, M_ELLIPSIS);
+		emit(code, make_fixnum(tail_len));
+		emit(code, make_fixnum(first_slot));
+		emit(code, make_fixnum(c->nslots - first_slot));
+		emit_body(code, &body);
+
+		compile_pattern(c, code, cddr(pat), depth);
+	}
+	else if (is_pair(pat)) {
+		emit_op(code, M_PAIR);
+		stack_change(code, 1);
+		compile_pattern(c, code, car(pat), depth);
+
+		emit_op(code, M_NEXT);
+		stack_change(code, -1);
+		compile_pattern(c, code, cdr(pat), depth);
+	}
+	else if (is_null(pat)) {
+		emit_op(code, M_NIL);
+	}
+	else if (is_vector(pat)) {
+		emit_op(code, M_VECTOR);
+		compile_pattern(c, code, vector_to_list(pat), depth);
+	}
+	else {
+		emit_op(code, M_DATUM);
+		emit(code, pat);
+	}
+}
+
+/* Templates */
+
+/* identifiers bound by the binding forms of a template */
+static void collect_binders(struct compiler *c, object tmpl);
+
+static void collect_binder(struct compiler *c, object name)
+{
+	if (is_symbol(name) && name != c->ellipsis && name != _underscore &&
+	    is_null(pattern_variable(c, name)) && !is_member(name, c->renames))
+		c->renames = cons(name, c->renames);
+}
+
+static void collect_binding_names(struct compiler *c, object bindings)
+{
+	for (; is_pair(bindings); bindings = cdr(bindings))
+		if (is_pair(car(bindings)))
+			collect_binder(c, caar(bindings));
+}
+
+static void collect_binders(struct compiler *c, object tmpl)
+{
+	object params, head;
+
+	if (!is_pair(tmpl))
+		return;
+
+	head = car(tmpl);
+
+	if (head == _lambda && is_pair(cdr(tmpl))) {
+		for (params = cadr(tmpl); is_pair(params); params = cdr(params))
+			collect_binder(c, car(params));
+		collect_binder(c, params);
+	}
+	else if ((head == _let || head == _letx || head == _letrec || head == _do) &&
+		 is_pair(cdr(tmpl))) {
+
+		/* named let */
+		if (head == _let && is_symbol(cadr(tmpl))) {
+			collect_binder(c, cadr(tmpl));
+			if (is_pair(cddr(tmpl)))
+				collect_binding_names(c, caddr(tmpl));
+		} else {
+			collect_binding_names(c, cadr(tmpl));
+		}
+	}
+
+	for (; is_pair(tmpl); tmpl = cdr(tmpl))
+		collect_binders(c, car(tmpl));
+}
+
+static long rename_index(struct compiler *c, object name)
+{
+	object lst;
+	long i = 0;
+
+	for (lst = c->renames; is_pair(lst); lst = cdr(lst), i++)
+		if (car(lst) == name)
+			return i;
+
+	return -1;
+}
+
+/* no pattern variables, renamed identifiers or ellipses in there */
+static int is_constant_template(struct compiler *c, object tmpl)
+{
+	long i;
+
+	if (is_symbol(tmpl))
+		return  tmpl != c->ellipsis &&
+			is_null(pattern_variable(c, tmpl)) &&
+			rename_index(c, tmpl) < 0;
+
+	if (is_vector(tmpl)) {
+		for (i = 0; i < vector_length(tmpl); i++)
+			if (!is_constant_template(c, vector_ref(tmpl, i)))
+				return 0;
+		return 1;
+	}
+
+	if (is_pair(tmpl))
+		return  is_constant_template(c, car(tmpl)) &&
+			is_constant_template(c, cdr(tmpl));
+
+	return 1;
+}
+
+/* the slots of variables used in tmpl that are deeper than depth */
+static object iterated_slots(struct compiler *c, object tmpl, long depth, object slots)
+{
+	object var;
+	long i;
+
+	if (is_symbol(tmpl)) {
+		var = pattern_variable(c, tmpl);
+
+		if (!is_null(var) && variable_depth(var) > depth &&
+		    !is_member(cadr(var), slots))
+			slots = cons(cadr(var), slots);
+	}
+	else if (is_vector(tmpl)) {
+		for (i = 0; i < vector_length(tmpl); i++)
+			slots = iterated_slots(c, vector_ref(tmpl, i), depth, slots);
+	}
+	else if (is_pair(tmpl)) {
+		slots = iterated_slots(c, car(tmpl), depth, slots);
+		slots = iterated_slots(c, cdr(tmpl), depth, slots);
+	}
+
+	return slots;
+}
+
+static void compile_template(struct compiler *c, struct code *code, object tmpl,
+			     long depth, int escaped);
+
+/* tmpl followed by the given number of ellipses, one level each, the
+   lists made by the inner ones spliced together */
+static void compile_ellipsis(struct compiler *c, struct code *code, object tmpl,
+			     long depth, long ellipses)
+{
+	struct code body;
+	object slots = iterated_slots(c, tmpl, depth, nil);
+
+	if (is_null(slots))
+		error("No pattern variables before ellipsis -- syntax-rules", tmpl);
+
+	code_init(&body);
+	if (ellipses > 1)
+		compile_ellipsis(c, &body, tmpl, depth + 1, ellipses - 1);
+	else
+		compile_template(c, &body, tmpl, depth + 1, 0);
+
+	emit_op(code, TPL_ELLIPSIS);
+	emit(code, make_fixnum(length(slots)));
+	for (; !is_null(slots); slots = cdr(slots))
+		emit(code, car(slots));
+	emit_body(code, &body);
+	stack_change(code, 1);
+
+	if (ellipses > 1)
+		emit_op(code, TPL_SPLICE);
+}
+
+static void compile_template(struct compiler *c, struct code *code, object tmpl,
+			     long depth, int escaped)
+{
+	object var, rest;
+	long index, ellipses;
+
+	if (is_symbol(tmpl)) {
+		var = pattern_variable(c, tmpl);
+
+		if (!is_null(var)) {
+			if (variable_depth(var) > depth)
+				error("Pattern variable used without ellipsis -- syntax-rules", tmpl);
+
+			emit_op(code, TPL_VAR);
+			emit(code, cadr(var));
+		} else if ((index = rename_index(c, tmpl)) >= 0) {
+			emit_op(code, TPL_RENAME);
+			emit(code, make_fixnum(index));
+		} else {
+			if (tmpl == c->ellipsis && !escaped)
+				error("Misplaced ellipsis -- syntax-rules", c->spec);
+
+			emit_op(code, TPL_CONST);
+			emit(code, tmpl);
+		}
+		stack_change(code, 1);
+	}
+	else if (is_constant_template(c, tmpl) && (escaped || !is_pair(tmpl) ||
+						   car(tmpl) != c->ellipsis)) {
+		emit_op(code, TPL_CONST);
+		emit(code, tmpl);
+		stack_change(code, 1);
+	}
+	/* (<ellipsis> template) escapes the ellipsis */
+	else if (is_pair(tmpl) && !escaped && car(tmpl) == c->ellipsis &&
+		 is_pair(cdr(tmpl)) && is_null(cddr(tmpl))) {
+		compile_template(c, code, cadr(tmpl), depth, 1);
+	}
+	/* (template <ellipsis> <ellipsis> ... . rest) */
+	else if (is_pair(tmpl) && !escaped && is_ellipsis_follower(c, tmpl)) {
+		for (rest = cdr(tmpl), ellipses = 0;
+		     is_pair(rest) && car(rest) == c->ellipsis;
+		     rest = cdr(rest))
+			ellipses++;
+
+		compile_ellipsis(c, code, car(tmpl), depth, ellipses);
+		compile_template(c, code, rest, depth, 0);
+
+		emit_op(code, TPL_APPEND);
+		stack_change(code, -1);
+	}
+	else if (is_pair(tmpl)) {
+		compile_template(c, code, car(tmpl), depth, escaped);
+		compile_template(c, code, cdr(tmpl), depth, escaped);
+
+		emit_op(code, TPL_CONS);
+		stack_change(code, -1);
+	}
+	else if (is_vector(tmpl)) {
+		c->temporaries = cons(vector_to_list(tmpl), c->temporaries);
+		compile_template(c, code, car(c->temporaries), depth, escaped);
+		emit_op(code, TPL_VECTOR);
+	}
+	else {
+		emit_op(code, TPL_CONST);
+		emit(code, tmpl);
+		stack_change(code, 1);
+	}
+}
+
+static object compile_rule(struct compiler *c, object rule)
+{
+	struct code matcher, template;
+	object compiled;
+
+	if (!is_list(rule) || length(rule) != 2 || !is_pair(car(rule)))
+		error("Ill-formed syntax rule -- syntax-rules", rule);
+
+	c->vars    = nil;
+	c->renames = nil;
+	c->nslots  = 0;
+
+	/* the keyword position is ignored */
+	code_init(&matcher);
+	compile_pattern(c, &matcher, cdar(rule), 0);
+
+	collect_binders(c, cadr(rule));
+
+	code_init(&template);
+	compile_template(c, &template, cadr(rule), 0, 0);
+
+	compiled = make_vector(RULE_SIZE, nil);
+	vector_set(compiled, RULE_SLOTS,       make_fixnum(c->nslots));
+	vector_set(compiled, RULE_RENAMES,     make_fixnum(length(c->renames)));
+	vector_set(compiled, RULE_MATCH_DEPTH, make_fixnum(matcher.max_depth));
+	vector_set(compiled, RULE_STACK_DEPTH, make_fixnum(template.max_depth));
+	vector_set(compiled, RULE_MATCHER,     code_to_vector(&matcher));
+	vector_set(compiled, RULE_TEMPLATE,    code_to_vector(&template));
+
+	return compiled;
+}
+
+/* (syntax-rules [ellipsis] (literal ...) (pattern template) ...) */
+object syntax_rules_compile(object spec)
+{
+	struct compiler c;
+	object rules, compiled;
+	long i;
+
+	if (!is_list(spec) || length(spec) < 2)
+		error("Ill-formed special form", spec);
+
+	c.spec        = spec;
+	c.ellipsis    = _ellipsis;
+	c.temporaries = nil;
+
+	rules = cdr(spec);
+	if (is_symbol(car(rules))) {
+		c.ellipsis = car(rules);
+		rules = cdr(rules);
+
+		if (is_null(rules))
+			error("Ill-formed special form", spec);
+	}
+
+	if (!is_list(car(rules)))
+		error("Expecting a list of literals -- syntax-rules", car(rules));
+
+	c.literals = car(rules);
+	rules = cdr(rules);
+
+	compiled = make_vector(length(rules), nil);
+
+	for (i = 0; !is_null(rules); rules = cdr(rules), i++)
+		vector_set(compiled, i, compile_rule(&c, car(rules)));
+
+	return make_syntax_rules(c.literals, compiled);
+}
+
+
+/* Expansion */
+
+/* the compiled code is a vector, worked on in place */
+static inline object code_at(object_ref *code, long ip)
+{
+	return decompress(code[ip]);
+}
+
+static int match(object_ref *code, long ip, long end, object o, object *slots, long depth)
+{
+	object stack[depth + 1];
+	object items;
+	long sp = 0, tail_len, first, count, body_len, n, k;
+
+	while (ip < end) {
+		switch (fixnum_value(code_at(code, ip++))) {
+		case M_PAIR:
+			if (!is_pair(o))
+				return 0;
+
+			stack[sp++] = cdr(o);
+			o = car(o);
+			break;
+
+		case M_NEXT:
+			o = stack[--sp];
+			break;
+
+		case M_NIL:
+			if (!is_null(o))
+				return 0;
+			break;
+
+		case M_ANY:
+			break;
+
+		case M_LITERAL:
+			if (o != code_at(code, ip++))
+				return 0;
+			break;
+
+		case M_DATUM:
+			if (!is_equal(o, code_at(code, ip++)))
+				return 0;
+			break;
+
+		case M_BIND:
+			slots[fixnum_value(code_at(code, ip++))] = o;
+			break;
+
+		case M_VECTOR:
+			if (!is_vector(o))
+				return 0;
+
+			o = vector_to_list(o);
+			break;
+
+		case M_ELLIPSIS:
+			tail_len = fixnum_value(code_at(code, ip++));
+			first    = fixnum_value(code_at(code, ip++));
+			count    = fixnum_value(code_at(code, ip++));
+			body_len = fixnum_value(code_at(code, ip++));
+
+			for (n = 0, items = o; is_pair(items); items = cdr(items))
+				n++;
+
+			if (n < tail_len)
+				return 0;
+
+			{
+				object matches[count + 1];
+
+				for (k = 0; k < count; k++)
+					matches[k] = nil;
+
+				/* collected in reverse */
+				for (n -= tail_len; n > 0; n--, o = cdr(o)) {
+					if (!match(code, ip, ip + body_len, car(o), slots, depth))
+						return 0;
+
+					for (k = 0; k < count; k++)
+						matches[k] = cons(slots[first + k], matches[k]);
+				}
+
+				for (k = 0; k < count; k++)
+					slots[first + k] = reverse_list(matches[k]);
+			}
+
+			ip += body_len;
+			break;
+
+		default:
+			assert(0);
+		}
+	}
+
+	return 1;
+}
+
+static object instantiate(object_ref *code, long ip, long end,
+			  object *slots, object *renames, long depth)
+{
+	object stack[depth + 1];
+	object head, tail, o;
+	long sp = 0, count, body_len, n, k, slot_ops;
+
+	while (ip < end) {
+		switch (fixnum_value(code_at(code, ip++))) {
+		case TPL_CONST:
+			stack[sp++] = code_at(code, ip++);
+			break;
+
+		case TPL_VAR:
+			stack[sp++] = slots[fixnum_value(code_at(code, ip++))];
+			break;
+
+		case TPL_RENAME:
+			stack[sp++] = renames[fixnum_value(code_at(code, ip++))];
+			break;
+
+		case TPL_CONS:
+			sp--;
+			stack[sp - 1] = cons(stack[sp - 1], stack[sp]);
+			break;
+
+		/* the list below was freshly made by TPL_ELLIPSIS */
+		case TPL_APPEND:
+			sp--;
+			if (is_null(stack[sp - 1])) {
+				stack[sp - 1] = stack[sp];
+			} else {
+				for (o = stack[sp - 1]; !is_null(cdr(o)); o = cdr(o))
+					;
+				set_cdr(o, stack[sp]);
+			}
+			break;
+
+		case TPL_VECTOR:
+			stack[sp - 1] = list_to_vector(stack[sp - 1]);
+			break;
+
+		case TPL_ELLIPSIS:
+			count    = fixnum_value(code_at(code, ip++));
+			slot_ops = ip;
+			ip      += count;
+			body_len = fixnum_value(code_at(code, ip++));
+
+			{
+				object saved[count], lists[count];
+
+				n = -1;
+				for (k = 0; k < count; k++) {
+					saved[k] = lists[k] = slots[fixnum_value(code_at(code, slot_ops + k))];
+
+					if (!is_list(lists[k]) ||
+					    (n >= 0 && n != length(lists[k])))
+						error("Ellipsis variables of different lengths -- syntax-rules",
+						      lists[k]);
+
+					n = length(lists[k]);
+				}
+
+				head = tail = nil;
+				while (n-- > 0) {
+					for (k = 0; k < count; k++) {
+						slots[fixnum_value(code_at(code, slot_ops + k))] = car(lists[k]);
+						lists[k] = cdr(lists[k]);
+					}
+
+					o = cons(instantiate(code, ip, ip + body_len,
+							     slots, renames, depth),
+						 nil);
+
+					if (is_null(head)) {
+						head = tail = o;
+					} else {
+						set_cdr(tail, o);
+						tail = o;
+					}
+				}
+
+				for (k = 0; k < count; k++)
+					slots[fixnum_value(code_at(code, slot_ops + k))] = saved[k];
+			}
+
+			stack[sp++] = head;
+			ip += body_len;
+			break;
+
+		/* the lists were freshly made by the TPL_ELLIPSIS inside */
+		case TPL_SPLICE:
+			head = tail = nil;
+			for (o = stack[sp - 1]; !is_null(o); o = cdr(o)) {
+				if (is_null(car(o)))
+					continue;
+
+				if (is_null(head))
+					head = car(o);
+				else
+					set_cdr(tail, car(o));
+
+				for (tail = car(o); !is_null(cdr(tail)); tail = cdr(tail))
+					;
+			}
+			stack[sp - 1] = head;
+			break;
+
+		default:
+			assert(0);
+		}
+	}
+
+	assert(sp == 1);
+	return stack[0];
+}
+
+object syntax_rules_expand(object transformer, object exp)
+{
+	object rules, rule, matcher, template;
+	unsigned long i;
+	long k, nslots, nrenames;
+
+	rules = syntax_rules_rules(transformer);
+
+	for (i = 0; i < vector_length(rules); i++) {
+		rule     = vector_ref(rules, i);
+		matcher  = vector_ref(rule, RULE_MATCHER);
+		template = vector_ref(rule, RULE_TEMPLATE);
+		nslots   = fixnum_value(vector_ref(rule, RULE_SLOTS));
+		nrenames = fixnum_value(vector_ref(rule, RULE_RENAMES));
+
+		{
+			object slots[nslots + 1], renames[nrenames + 1];
+
+			if (!match(vector_ptr(matcher), 0, vector_length(matcher),
+				   cdr(exp), slots,
+				   fixnum_value(vector_ref(rule, RULE_MATCH_DEPTH))))
+				continue;
+
+			for (k = 0; k < nrenames; k++)
+				renames[k] = gensym();
+
+			return instantiate(vector_ptr(template), 0, vector_length(template),
+					   slots, renames,
+					   fixnum_value(vector_ref(rule, RULE_STACK_DEPTH)));
+		}
+	}
+
+	error("No matching syntax rule", exp);
+	return nil; /* not reached */
+}
+
+void syntax_init()
+{
+	_underscore = make_symbol_c("_");
+}
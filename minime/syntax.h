@@ -0,0 +1,10 @@
+#ifndef __SYNTAX_H
+#define __SYNTAX_H
+
+/* (syntax-rules ...) => transformer */
+extern object syntax_rules_compile(object spec);
+extern object syntax_rules_expand(object transformer, object exp);
+
+extern void syntax_init();
+
+#endif
@@ -0,0 +1,153 @@
+/* weak.c -- eq?-keyed hash tables that don't keep their keys alive
+
+   Every entry is an ephemeron, in a list hanging off a vector of
+   buckets. The collector breaks the ephemerons of dead keys; they are
+   dropped from the lists as the buckets get looked at. Since objects
+   never move, addresses make stable hashes. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "minime.h"
+
+static inline unsigned long eq_hash(object key)
+{
+	unsigned long h = (unsigned long) key;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+static inline unsigned long bucket_index(object table, object key)
+{
+	return eq_hash(key) & (vector_length(weak_table_buckets(table)) - 1);
+}
+
+/* the entries of bucket i, after dropping the broken ones */
+static object bucket_entries(object table, unsigned long i)
+{
+	object buckets = weak_table_buckets(table);
+	object entries, prev = nil;
+	unsigned long dropped = 0;
+
+	for (entries = vector_ref(buckets, i); !is_null(entries); entries = cdr(entries)) {
+		if (!is_ephemeron_broken(car(entries))) {
+			prev = entries;
+			continue;
+		}
+
+		if (is_null(prev))
+			vector_set(buckets, i, cdr(entries));
+		else
+			set_cdr(prev, cdr(entries));
+
+		dropped++;
+	}
+
+	if (dropped > 0)
+		set_weak_table_contents(table, buckets, weak_table_count(table) - dropped);
+
+	return vector_ref(buckets, i);
+}
+
+static object find_entry(object table, object key)
+{
+	object entries;
+
+	for (entries = bucket_entries(table, bucket_index(table, key));
+	     !is_null(entries);
+	     entries = cdr(entries))
+		if (ephemeron_key(car(entries)) == key)
+			return car(entries);
+
+	return NULL;
+}
+
+static void resize(object table, unsigned long size)
+{
+	object old = weak_table_buckets(table), buckets = make_vector(size, nil);
+	object entries, entry;
+	unsigned long i, j, count = 0;
+
+	for (i = 0; i < vector_length(old); i++)
+		for (entries = vector_ref(old, i); !is_null(entries); entries = cdr(entries)) {
+			entry = car(entries);
+			if (is_ephemeron_broken(entry))
+				continue;
+
+			j = eq_hash(ephemeron_key(entry)) & (size - 1);
+			vector_set(buckets, j, cons(entry, vector_ref(buckets, j)));
+			count++;
+		}
+
+	set_weak_table_contents(table, buckets, count);
+}
+
+int weak_table_lookup(object table, object key, object *value)
+{
+	object entry = find_entry(table, key);
+
+	if (entry == NULL)
+		return 0;
+
+	*value = ephemeron_value(entry);
+	return 1;
+}
+
+void weak_table_insert(object table, object key, object value)
+{
+	object buckets, entry = find_entry(table, key);
+	unsigned long i;
+
+	if (entry != NULL) {
+		set_ephemeron_value(entry, value);
+		return;
+	}
+
+	/* broken entries count until dropped, they may make up the excess */
+	buckets = weak_table_buckets(table);
+	if (weak_table_count(table) >= 2 * vector_length(buckets) &&
+	    weak_table_entries(table) >= vector_length(buckets))
+		resize(table, 2 * vector_length(buckets));
+
+	entry   = make_ephemeron(key, value);
+	buckets = weak_table_buckets(table);
+	i       = bucket_index(table, key);
+
+	vector_set(buckets, i, cons(entry, vector_ref(buckets, i)));
+	set_weak_table_contents(table, buckets, weak_table_count(table) + 1);
+}
+
+void weak_table_delete(object table, object key)
+{
+	object buckets = weak_table_buckets(table);
+	object entries, prev = nil;
+	unsigned long i = bucket_index(table, key);
+
+	for (entries = vector_ref(buckets, i); !is_null(entries); prev = entries, entries = cdr(entries)) {
+		if (ephemeron_key(car(entries)) != key || is_ephemeron_broken(car(entries)))
+			continue;
+
+		if (is_null(prev))
+			vector_set(buckets, i, cdr(entries));
+		else
+			set_cdr(prev, cdr(entries));
+
+		set_weak_table_contents(table, buckets, weak_table_count(table) - 1);
+		return;
+	}
+}
+
+unsigned long weak_table_entries(object table)
+{
+	unsigned long i, size = vector_length(weak_table_buckets(table));
+
+	for (i = 0; i < size; i++)
+		bucket_entries(table, i);
+
+	return weak_table_count(table);
+}
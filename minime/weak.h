@@ -0,0 +1,11 @@
+#ifndef __WEAK_H
+#define __WEAK_H
+
+#define WEAK_TABLE_MIN_SIZE 16
+
+extern int  weak_table_lookup(object table, object key, object *value);
+extern void weak_table_insert(object table, object key, object value);
+extern void weak_table_delete(object table, object key);
+extern unsigned long weak_table_entries(object table);
+
+#endif